@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <lunatic/memory.hpp>
+#include <vector>
+
+/**
+ * Guest memory for the benchmarks: 4 MiB of RAM at 0x00000000, which is mapped through the pagetable,
+ * and a single status register at 0x04000000, which is read through the slow path.
+ * Like a typical vblank flag, bit 0 of the status register is set on every 64th read.
+ */
+struct FlatMemory final : lunatic::Memory {
+  static constexpr u32 kRAMSize = 0x400000;
+  static constexpr u32 kStatusAddress = 0x04000000;
+  static constexpr int kStatusPeriod = 64;
+
+  FlatMemory() {
+    ram.resize(kRAMSize);
+
+    pagetable = std::make_unique<std::array<u8*, 1048576>>();
+
+    for (u32 page = 0; page < (kRAMSize >> kPageShift); page++) {
+      (*pagetable)[page] = &ram[page << kPageShift];
+    }
+  }
+
+  auto ReadByte(u32 address, Bus bus) -> u8 override {
+    return u8(ReadWord(address & ~3, bus) >> ((address & 3) * 8));
+  }
+
+  auto ReadHalf(u32 address, Bus bus) -> u16 override {
+    return u16(ReadWord(address & ~3, bus) >> ((address & 2) * 8));
+  }
+
+  auto ReadWord(u32 address, Bus bus) -> u32 override {
+    if (address == kStatusAddress) {
+      return (++status_reads % kStatusPeriod) == 0 ? 1 : 0;
+    }
+    return 0;
+  }
+
+  void WriteByte(u32 address, u8  value, Bus bus) override {}
+  void WriteHalf(u32 address, u16 value, Bus bus) override {}
+  void WriteWord(u32 address, u32 value, Bus bus) override {}
+
+  std::vector<u8> ram;
+  u64 status_reads = 0;
+};
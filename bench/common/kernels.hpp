@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <lunatic/integer.hpp>
+#include <vector>
+
+#include "flat_memory.hpp"
+
+/**
+ * Synthetic guest programs, which loop forever.
+ * They are position-independent and expect a stack in RAM if they call functions.
+ */
+struct Kernel {
+  char const* name;
+  bool thumb;
+  std::vector<u32> arm_code;
+  std::vector<u16> thumb_code;
+  int literal_pool_words = 0;
+
+  void Load(FlatMemory& memory, u32 address) const {
+    if (thumb) {
+      std::memcpy(&memory.ram[address], thumb_code.data(), thumb_code.size() * sizeof(u16));
+    } else {
+      std::memcpy(&memory.ram[address], arm_code.data(), arm_code.size() * sizeof(u32));
+    }
+  }
+
+  // Returns the size in bytes of the instructions, excluding the literal pool at the end.
+  auto GetCodeSize() const -> u32 {
+    if (thumb) {
+      return u32(thumb_code.size() * sizeof(u16));
+    }
+    return u32((arm_code.size() - literal_pool_words) * sizeof(u32));
+  }
+};
+
+static constexpr u32 kKernelLoadAddress = 0x00008000;
+static constexpr u32 kKernelStackAddress = 0x003FFF00;
+
+inline auto GetKernels() -> std::vector<Kernel> const& {
+  static const std::vector<Kernel> kernels {
+    {
+      "alu", false, {
+        0xE3A00000, //   mov r0, #0
+        0xE3A01412, //   mov r1, #0x12000000
+        0xE381170D, //   orr r1, r1, #0x340000
+        0xE3811C56, //   orr r1, r1, #0x5600
+        0xE3811078, //   orr r1, r1, #0x78
+                    // loop:
+        0xE0800001, //   add r0, r0, r1
+        0xE02113E0, //   eor r1, r1, r0, ror #7
+        0xE0402181, //   sub r2, r0, r1, lsl #3
+        0xE18232A0, //   orr r3, r2, r0, lsr #5
+        0xE0034001, //   and r4, r3, r1
+        0xE0050094, //   mul r5, r4, r0
+        0xE0956002, //   adds r6, r5, r2
+        0xE0A77006, //   adc r7, r7, r6
+        0xE1C78003, //   bic r8, r7, r3
+        0xE1E09008, //   mvn r9, r8
+        0xE069A144, //   rsb r10, r9, r4, asr #2
+        0xE02AB27B, //   eor r11, r10, r11, ror r2
+        0xEAFFFFF2  //   b loop
+      }
+    },
+    {
+      "memcpy", false, {
+                    // start:
+        0xE3A00601, //   mov r0, #0x100000
+        0xE3A01602, //   mov r1, #0x200000
+        0xE3A02080, //   mov r2, #128
+                    // copy:
+        0xE8B007F8, //   ldmia r0!, {r3-r10}
+        0xE8A107F8, //   stmia r1!, {r3-r10}
+        0xE2522001, //   subs r2, r2, #1
+        0x1AFFFFFB, //   bne copy
+        0xEAFFFFF7  //   b start
+      }
+    },
+    {
+      "literal-pool", false, {
+                    // loop:
+        0xE59F0038, //   ldr r0, =0x11111111
+        0xE59F1038, //   ldr r1, =0x22222222
+        0xE0802001, //   add r2, r0, r1
+        0xE59F3034, //   ldr r3, =0x33333333
+        0xE59F4034, //   ldr r4, =0x44444444
+        0xE0235004, //   eor r5, r3, r4
+        0xE59F6030, //   ldr r6, =0x55555555
+        0xE59F7030, //   ldr r7, =0x66666666
+        0xE0478006, //   sub r8, r7, r6
+        0xE59F902C, //   ldr r9, =0x77777777
+        0xE59FA02C, //   ldr r10, =0x88888888
+        0xE189B00A, //   orr r11, r9, r10
+        0xE082C005, //   add r12, r2, r5
+        0xE08CC008, //   add r12, r12, r8
+        0xE08CC00B, //   add r12, r12, r11
+        0xEAFFFFEF, //   b loop
+        0x11111111, 0x22222222, 0x33333333, 0x44444444,
+        0x55555555, 0x66666666, 0x77777777, 0x88888888
+      }, {}, 8
+    },
+    {
+      "conditional", false, {
+        0xE3A00000, //   mov r0, #0
+                    // loop:
+        0xE2800001, //   add r0, r0, #1
+        0xE3100001, //   tst r0, #1
+        0x10811000, //   addne r1, r1, r0
+        0x00422000, //   subeq r2, r2, r0
+        0xE1510002, //   cmp r1, r2
+        0xC1A03001, //   movgt r3, r1
+        0xD1A03002, //   movle r3, r2
+        0xE3100004, //   tst r0, #4
+        0x10244003, //   eorne r4, r4, r3
+        0x01855003, //   orreq r5, r5, r3
+        0xE1540005, //   cmp r4, r5
+        0x82866001, //   addhi r6, r6, #1
+        0x92877001, //   addls r7, r7, #1
+        0xE3500C01, //   cmp r0, #256
+        0x03A00000, //   moveq r0, #0
+        0xEAFFFFEF  //   b loop
+      }
+    },
+    {
+      "thumb-calls", true, {}, {
+        0x2000,         //   movs r0, #0
+                        // loop:
+        0xF000, 0xF801, //   bl f1
+        0xE7FC,         //   b loop
+                        // f1:
+        0xB500,         //   push {lr}
+        0x3001,         //   adds r0, #1
+        0xF000, 0xF801, //   bl f2
+        0xBD00,         //   pop {pc}
+                        // f2:
+        0xB510,         //   push {r4, lr}
+        0x0084,         //   lsls r4, r0, #2
+        0xF000, 0xF802, //   bl f3
+        0x1909,         //   adds r1, r1, r4
+        0xBD10,         //   pop {r4, pc}
+                        // f3:
+        0x180A,         //   adds r2, r1, r0
+        0x4053,         //   eors r3, r2
+        0x4770          //   bx lr
+      }
+    },
+    {
+      "mmio-poll", false, {
+        0xE3A04301, //   mov r4, #0x04000000
+                    // loop:
+        0xE5940000, //   ldr r0, [r4]
+        0xE3100001, //   tst r0, #1
+        0x0AFFFFFC, //   beq loop
+        0xE2855001, //   add r5, r5, #1
+        0xEAFFFFFA  //   b loop
+      }
+    }
+  };
+
+  return kernels;
+}
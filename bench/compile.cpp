@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <chrono>
+#include <fmt/format.h>
+#include <lunatic/cpu.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "backend/backend.hpp"
+#include "frontend/ir_opt/constant_propagation.hpp"
+#include "frontend/ir_opt/context_load_store_elision.hpp"
+#include "frontend/ir_opt/dead_code_elision.hpp"
+#include "frontend/ir_opt/dead_flag_elision.hpp"
+#include "frontend/translator/translator.hpp"
+
+#include "common/flat_memory.hpp"
+#include "common/kernels.hpp"
+
+using namespace lunatic;
+using namespace lunatic::frontend;
+using namespace lunatic::backend;
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr int kRounds = 200;
+static constexpr u32 kKernelSpacing = 0x1000;
+
+struct Pipeline {
+  Pipeline(CPU::Descriptor const& descriptor) : translator(descriptor) {
+    backend = Backend::CreateBackend(descriptor, block_cache);
+
+    // Same passes in the same order as the JIT runs them.
+    AddPass<IRContextLoadStoreElisionPass>("ctx-elide");
+    AddPass<IRDeadFlagElisionPass>("flag-elide");
+    AddPass<IRConstantPropagationPass>("const-prop");
+    AddPass<IRDeadCodeElisionPass>("dce");
+  }
+
+  template<typename T>
+  void AddPass(char const* name) {
+    passes.push_back(std::make_unique<T>());
+    pass_names.push_back(name);
+  }
+
+  Translator translator;
+  BasicBlockCache block_cache;
+  std::unique_ptr<Backend> backend;
+  std::vector<std::unique_ptr<IRPass>> passes;
+  std::vector<char const*> pass_names;
+};
+
+struct Result {
+  u64 guest_instructions = 0;
+  u64 host_bytes = 0;
+  Clock::duration translate{};
+  std::vector<Clock::duration> passes;
+  Clock::duration backend{};
+};
+
+/**
+ * Every instruction of a kernel starts one block of the corpus,
+ * so that the corpus contains blocks of all lengths which appear in the kernel.
+ */
+static auto GetCorpus(Kernel const& kernel, u32 address) -> std::vector<BasicBlock::Key> {
+  auto corpus = std::vector<BasicBlock::Key>{};
+  auto opcode_size = kernel.thumb ? sizeof(u16) : sizeof(u32);
+
+  for (u32 offset = 0; offset < kernel.GetCodeSize(); offset += opcode_size) {
+    corpus.push_back(BasicBlock::Key{u32(address + offset + 2 * opcode_size), Mode::System, kernel.thumb});
+  }
+
+  return corpus;
+}
+
+static void RunRound(Pipeline& pipeline, std::vector<BasicBlock::Key> const& corpus, Result& result) {
+  auto basic_blocks = std::vector<BasicBlock*>{};
+
+  auto time_start = Clock::now();
+
+  for (auto key : corpus) {
+    auto basic_block = new BasicBlock{key};
+
+    pipeline.translator.Translate(*basic_block);
+    basic_blocks.push_back(basic_block);
+  }
+
+  result.translate += Clock::now() - time_start;
+
+  for (size_t i = 0; i < pipeline.passes.size(); i++) {
+    auto& pass = pipeline.passes[i];
+
+    time_start = Clock::now();
+
+    for (auto basic_block : basic_blocks) {
+      for (auto& micro_block : basic_block->micro_blocks) {
+        pass->Run(micro_block.emitter);
+      }
+    }
+
+    result.passes[i] += Clock::now() - time_start;
+  }
+
+  /* The blocks are inserted into the block cache like the JIT would do it,
+   * so that block linking is part of the measurement.
+   */
+  time_start = Clock::now();
+
+  for (auto basic_block : basic_blocks) {
+    pipeline.backend->Compile(*basic_block);
+    pipeline.block_cache.Set(basic_block->key, basic_block);
+  }
+
+  result.backend += Clock::now() - time_start;
+
+  for (auto basic_block : basic_blocks) {
+    result.guest_instructions += basic_block->length;
+    result.host_bytes += basic_block->function_size;
+  }
+
+  pipeline.block_cache.Flush();
+}
+
+static void PrintRow(std::string const& name, Result const& result) {
+  auto ns_per_instruction = [&](Clock::duration duration) {
+    return std::chrono::duration<double, std::nano>(duration).count() / result.guest_instructions;
+  };
+
+  auto total = result.translate + result.backend;
+
+  fmt::print("{:<14} {:>9.1f}", name, ns_per_instruction(result.translate));
+  for (auto duration : result.passes) {
+    fmt::print(" {:>10.1f}", ns_per_instruction(duration));
+    total += duration;
+  }
+  fmt::print(" {:>9.1f} {:>9.1f} {:>12.1f}\n",
+    ns_per_instruction(result.backend),
+    ns_per_instruction(total),
+    double(result.host_bytes) / result.guest_instructions
+  );
+}
+
+/**
+ * Usage: lunatic-bench-compile
+ * Feeds the blocks of each synthetic kernel through the translator, each IR pass
+ * and the backend in isolation and reports the time per guest instruction for each phase.
+ * The backend column includes register allocation, code emission and block linking.
+ */
+int main() {
+  auto memory = FlatMemory{};
+  auto& kernels = GetKernels();
+  // The block cache tables are too large for the stack.
+  auto pipeline = std::make_unique<Pipeline>(CPU::Descriptor{memory});
+  auto total = Result{};
+
+  total.passes.resize(pipeline->passes.size());
+
+  fmt::print("{:<14} {:>9}", "kernel", "translate");
+  for (auto name : pipeline->pass_names) {
+    fmt::print(" {:>10}", name);
+  }
+  fmt::print(" {:>9} {:>9} {:>12}\n", "backend", "total", "bytes/insn");
+
+  for (size_t i = 0; i < kernels.size(); i++) {
+    auto address = kKernelLoadAddress + u32(i) * kKernelSpacing;
+    auto corpus = GetCorpus(kernels[i], address);
+    auto result = Result{};
+
+    kernels[i].Load(memory, address);
+    result.passes.resize(pipeline->passes.size());
+
+    for (int round = 0; round < kRounds; round++) {
+      RunRound(*pipeline, corpus, result);
+    }
+
+    PrintRow(kernels[i].name, result);
+
+    total.guest_instructions += result.guest_instructions;
+    total.host_bytes += result.host_bytes;
+    total.translate += result.translate;
+    total.backend += result.backend;
+    for (size_t j = 0; j < result.passes.size(); j++) {
+      total.passes[j] += result.passes[j];
+    }
+  }
+
+  PrintRow("all", total);
+  return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <fmt/format.h>
+#include <lunatic/cpu.hpp>
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#else
+  #include <x86intrin.h>
+#endif
+
+#include "common/flat_memory.hpp"
+#include "common/kernels.hpp"
+
+using namespace lunatic;
+
+static constexpr int kSliceCycles = 100000;
+static constexpr int kWarmupSlices = 10;
+static constexpr auto kDuration = std::chrono::milliseconds{1000};
+
+struct Result {
+  u64 instructions = 0;
+  u64 run_calls = 0;
+  u64 host_cycles = 0;
+  u64 returns_to_dispatcher = 0;
+  u64 dispatch_misses = 0;
+  double seconds = 0;
+};
+
+static auto RunKernel(Kernel const& kernel, bool position_independent_code) -> Result {
+  auto memory = FlatMemory{};
+  auto descriptor = CPU::Descriptor{memory};
+
+  descriptor.position_independent_code = position_independent_code;
+
+  auto cpu = CreateCPU(descriptor);
+  auto cpsr = StatusRegister{};
+
+  kernel.Load(memory, kKernelLoadAddress);
+
+  cpsr.f.mode = Mode::System;
+  cpsr.f.thumb = kernel.thumb;
+  cpu->SetCPSR(cpsr);
+  cpu->SetGPR(GPR::SP, kKernelStackAddress);
+  cpu->SetGPR(GPR::PC, kKernelLoadAddress);
+
+  // Compile all blocks of the kernel before measuring.
+  for (int i = 0; i < kWarmupSlices; i++) {
+    cpu->Run(kSliceCycles);
+  }
+
+  auto result = Result{};
+  auto statistics_start = cpu->GetStatistics();
+  auto time_start = std::chrono::steady_clock::now();
+  auto time_now = time_start;
+  auto tsc_start = __rdtsc();
+
+  do {
+    result.instructions += cpu->Run(kSliceCycles);
+    result.run_calls++;
+    time_now = std::chrono::steady_clock::now();
+  } while (time_now - time_start < kDuration);
+
+  result.host_cycles = __rdtsc() - tsc_start;
+  result.seconds = std::chrono::duration<double>(time_now - time_start).count();
+
+  auto statistics = cpu->GetStatistics();
+
+  result.returns_to_dispatcher = statistics.returns_to_dispatcher - statistics_start.returns_to_dispatcher;
+  result.dispatch_misses = statistics.dispatch_misses - statistics_start.dispatch_misses;
+  return result;
+}
+
+static bool IsOption(char const* argument) {
+  return std::strncmp(argument, "--", 2) == 0;
+}
+
+static bool HasOption(char const* option, int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], option) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool IsSelected(Kernel const& kernel, int argc, char** argv) {
+  bool any_selected = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (IsOption(argv[i])) {
+      continue;
+    }
+
+    if (std::strcmp(argv[i], kernel.name) == 0) {
+      return true;
+    }
+
+    any_selected = true;
+  }
+
+  return !any_selected;
+}
+
+/**
+ * Usage: lunatic-bench-execution [--pic | --compare] [kernel...]
+ * Runs each (or each given) synthetic kernel for about one second and reports the guest
+ * instruction throughput. Host cycles are measured with the time-stamp counter.
+ * --pic generates position-independent code, as required by the persistent code cache.
+ * --compare runs each kernel with absolute and with position-independent code and reports the difference.
+ */
+int main(int argc, char** argv) {
+  auto position_independent_code = HasOption("--pic", argc, argv);
+
+  if (HasOption("--compare", argc, argv)) {
+    fmt::print("{:<14} {:>14} {:>14} {:>14} {:>14} {:>10}\n",
+      "kernel", "MIPS (abs)", "MIPS (PIC)", "TSC/insn (abs)", "TSC/insn (PIC)", "PIC cost");
+
+    for (auto const& kernel : GetKernels()) {
+      if (!IsSelected(kernel, argc, argv)) {
+        continue;
+      }
+
+      auto absolute = RunKernel(kernel, false);
+      auto pic = RunKernel(kernel, true);
+      auto absolute_cycles = double(absolute.host_cycles) / absolute.instructions;
+      auto pic_cycles = double(pic.host_cycles) / pic.instructions;
+
+      fmt::print("{:<14} {:>14.2f} {:>14.2f} {:>14.2f} {:>14.2f} {:>+9.1f}%\n",
+        kernel.name,
+        absolute.instructions / absolute.seconds / 1e6,
+        pic.instructions / pic.seconds / 1e6,
+        absolute_cycles,
+        pic_cycles,
+        (pic_cycles / absolute_cycles - 1) * 100
+      );
+    }
+
+    return 0;
+  }
+
+  fmt::print("{:<14} {:>12} {:>14} {:>10} {:>12} {:>12}\n",
+    "kernel", "guest MIPS", "TSC/guest insn", "Run calls", "returns", "cache misses");
+
+  for (auto const& kernel : GetKernels()) {
+    if (!IsSelected(kernel, argc, argv)) {
+      continue;
+    }
+
+    auto result = RunKernel(kernel, position_independent_code);
+
+    fmt::print("{:<14} {:>12.2f} {:>14.2f} {:>10} {:>12} {:>12}\n",
+      kernel.name,
+      result.instructions / result.seconds / 1e6,
+      double(result.host_cycles) / result.instructions,
+      result.run_calls,
+      result.returns_to_dispatcher,
+      result.dispatch_misses
+    );
+  }
+
+  return 0;
+}
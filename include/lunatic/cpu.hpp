@@ -10,6 +10,8 @@
 #include <lunatic/coprocessor.hpp>
 #include <lunatic/memory.hpp>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace lunatic {
 
@@ -58,6 +60,12 @@ union StatusRegister {
   u32 v = static_cast<u32>(Mode::System);
 };
 
+/// Translated code, which may be shared between CPU instances.
+/// See CPU::GetCodeCache() and CPU::Descriptor::code_cache.
+struct CodeCache {
+  virtual ~CodeCache() = default;
+};
+
 struct CPU {
   struct Descriptor {
     Memory& memory;
@@ -68,6 +76,59 @@ struct CPU {
       ARM9
     } model = Model::ARM9;
     int block_size = 32;
+
+    // Address memory, coprocessors and the block cache relative to the guest state,
+    // instead of embedding their absolute addresses into the compiled code.
+    // This is slightly slower, but makes the code independent of the CPU instance.
+    bool position_independent_code = false;
+
+    // Optional: reuse the code cache of another CPU instead of creating a new one.
+    // All CPUs sharing a code cache must use the same model, block size and code generation mode.
+    // Unless position-independent code is enabled they also must use the same memory and coprocessors,
+    // otherwise they must run the same guest code, which is translated from the first CPU's memory.
+    // They also share the exception base and must not run concurrently.
+    std::shared_ptr<CodeCache> code_cache = nullptr;
+
+    // Detect basic blocks which branch to themselves and only poll memory (e.g. waiting for vblank),
+    // and skip the remaining cycles of Run() once such a loop is entered. See CPU::InIdleLoop().
+    // Only enable this if repeated reads from the polled addresses have no side effects.
+    bool enable_idle_loop_detection = false;
+  };
+
+  // Counters for monitoring the JIT. They are updated without synchronization by the thread running the CPU.
+  // CPUs sharing a code cache report the same compilation counters, but have separate dispatch counters.
+  struct Statistics {
+    u64 compiled_blocks = 0;
+    u64 compiled_guest_instructions = 0;
+    u64 code_buffer_bytes = 0;
+    u64 flushes = 0;
+    u64 range_invalidations = 0;
+    u64 dispatch_misses = 0;       // block cache lookups in compiled code, which called into the dispatcher
+    u64 returns_to_dispatcher = 0; // returns from compiled code to Run()
+    u64 link_patches = 0;
+
+    // Cumulative time spent compiling basic blocks, in nanoseconds.
+    struct {
+      u64 translate = 0;
+      u64 optimize = 0;
+      u64 backend = 0; // also includes blocks restored from a code cache file
+    } compile_time_ns;
+  };
+
+  // Samples collected by the sampling profiler, aggregated per guest instruction.
+  struct Profile {
+    struct Entry {
+      u32 address;       // address of the guest instruction
+      u32 block_address; // address of the basic block, which contains the instruction
+      Mode mode;
+      bool thumb;
+      u64 samples;
+    };
+
+    std::vector<Entry> entries; // sorted by descending sample count
+    u64 samples = 0;
+    u64 samples_outside_guest_code = 0;
+    u64 samples_dropped = 0;
   };
 
   virtual ~CPU() = default;
@@ -81,6 +142,47 @@ struct CPU {
   virtual void ClearICacheRange(u32 address_lo, u32 address_hi) = 0;
   virtual auto Run(int cycles) -> int = 0;
 
+  // Returns true if the last call to Run() ended early in an idle loop.
+  // The CPU will not make progress until the polled memory changes,
+  // so the embedder may advance its scheduler to the next event.
+  virtual bool InIdleLoop() const = 0;
+
+  virtual auto GetStatistics() const -> Statistics = 0;
+
+  // Sample the host program counter every `interval_us` microseconds of CPU time and attribute
+  // the samples to guest instructions. This is only supported on Linux and must be called on
+  // the thread which runs the CPU. Starting the profiler discards the previous profile.
+  virtual void StartProfiling(int interval_us) = 0;
+  virtual void StopProfiling() = 0;
+  virtual auto GetProfile() -> Profile = 0;
+
+  // Compile all basic blocks in [address_lo, address_hi], which are statically reachable from address_lo
+  // (in the given mode and instruction set) or from the current program counter.
+  virtual void Precompile(u32 address_lo, u32 address_hi, Mode mode, bool thumb) = 0;
+
+  // Returns the code cache, which can be passed to other CPUs through CPU::Descriptor::code_cache.
+  // CPUs which share a code cache must not run concurrently. Calling Run(), Precompile() or any method that
+  // modifies the code cache while another thread does the same with a CPU sharing it throws std::logic_error.
+  // Reset() only discards the compiled code while the code cache is not shared. Use ClearICache() instead,
+  // to discard the compiled code of all CPUs sharing it.
+  virtual auto GetCodeCache() -> std::shared_ptr<CodeCache> = 0;
+
+  // Load or save compiled code from or to a file, to speed up subsequent runs.
+  // Loaded code is used once it is first executed and the guest code matches.
+  // This requires position-independent code and returns false on I/O errors, corrupted or incompatible files.
+  // Files are incompatible with other versions or builds of the library, which change the layout of the guest state.
+  virtual bool LoadCodeCache(std::string const& path) = 0;
+  virtual bool SaveCodeCache(std::string const& path) = 0;
+
+  // The request methods below are thread-safe and may be called from any thread,
+  // while Run() executes on another. Requests are observed at the next basic block boundary.
+  // - RequestInterrupt(): latch an IRQ, which is kept pending until the CPU accepts it.
+  // - RequestHalt(): enter the wait-for-IRQ state and return from Run().
+  // - RequestExit(): return from Run() early.
+  virtual void RequestInterrupt() = 0;
+  virtual void RequestHalt() = 0;
+  virtual void RequestExit() = 0;
+
   virtual auto GetGPR(GPR reg) const -> u32 = 0;
   virtual auto GetGPR(GPR reg, Mode mode) const -> u32 = 0;
   virtual auto GetCPSR() const -> StatusRegister = 0;
@@ -12,16 +12,78 @@
 namespace lunatic {
 namespace backend {
 
+/**
+ * Per-CPU data, which position-independent code addresses through the
+ * pinned guest state register. The guest state must come first,
+ * so that offsets into State also are offsets into the Context.
+ */
+struct Context {
+  struct Call {
+    u64 fn = 0;
+    u64 arg = 0;
+  };
+
+  frontend::State state;
+
+  void* block_cache = nullptr;
+  u8** pagetable = nullptr;
+  Memory::TCM* itcm = nullptr;
+  Memory::TCM* dtcm = nullptr;
+
+  Call read_byte;
+  Call read_half;
+  Call read_word;
+  Call write_byte;
+  Call write_half;
+  Call write_word;
+
+  Call coprocessor_read[16];
+  Call coprocessor_write[16];
+
+  // Called by compiled code, when a basic block returns to the dispatcher with cycles left.
+  // Returns the compiled code to continue with, or zero to return from Backend::Call().
+  Call dispatch;
+
+  // Incremented by compiled code, see CPU::Statistics.
+  u64 dispatch_misses = 0;
+};
+
 struct Backend {
+  struct Statistics {
+    u64 code_buffer_bytes = 0;
+    u64 flushes = 0;
+    u64 link_patches = 0;
+  };
+
   virtual ~Backend() = default;
 
   virtual void Compile(frontend::BasicBlock& basic_block) = 0;
-  virtual int Call(frontend::BasicBlock const& basic_block, int max_cycles) = 0;
+
+  // Append the compiled code of a basic block to a buffer, so that it can be restored by Deserialize().
+  // Returns false if the code cannot be relocated.
+  virtual bool Serialize(frontend::BasicBlock const& basic_block, std::vector<u8>& buffer) = 0;
+
+  // Check that serialized code is well-formed, before it is passed to Deserialize().
+  virtual bool IsValidSerialization(u8 const* data, size_t size) const = 0;
+
+  // Install previously serialized code for a basic block,
+  // which must have been set up with the same attributes as at serialization time.
+  virtual void Deserialize(frontend::BasicBlock& basic_block, u8 const* data, size_t size) = 0;
+  virtual void InitializeContext(Context& context, CPU::Descriptor const& descriptor) = 0;
+  virtual int Call(frontend::BasicBlock const& basic_block, Context& context, int max_cycles) = 0;
+
+  // Basic blocks which are released between these calls are released as a batch,
+  // which lets the backend patch the jumps into them with a single change of the page protection.
+  // The calls may be nested.
+  virtual void BeginRelease() = 0;
+  virtual void EndRelease() = 0;
+
+  // Get the compiled code of a basic block, which the dispatcher can continue with.
+  virtual auto GetEntryPoint(frontend::BasicBlock const& basic_block) -> frontend::BasicBlock::CompiledFn = 0;
+  virtual auto GetStatistics() const -> Statistics = 0;
 
   static std::unique_ptr<Backend> CreateBackend(CPU::Descriptor const& descriptor,
-                                                frontend::State& state,
-                                                frontend::BasicBlockCache& block_cache,
-                                                bool const& irq_line);
+                                                frontend::BasicBlockCache& block_cache);
 };
 
 } // namespace lunatic::backend
@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <list>
 #include <stdexcept>
 
@@ -14,30 +15,29 @@
 #include "common.hpp"
 #include "common/aligned_memory.hpp"
 #include "common/bit.hpp"
+#include "perf.hpp"
 #include "vtune.hpp"
 
-/**
- * TODO:
- * - think of a way to merge memory operands into X64 opcodes across IR opcodes.
- * - ...
- */
-
 namespace lunatic {
 namespace backend {
 
 X64Backend::X64Backend(
   CPU::Descriptor const& descriptor,
-  State& state,
-  BasicBlockCache& block_cache,
-  bool const& irq_line
+  BasicBlockCache& block_cache
 )   : memory(descriptor.memory)
-    , state(state)
     , coprocessors(descriptor.coprocessors)
-    , block_cache(block_cache)
-    , irq_line(irq_line) {
+    , model(descriptor.model)
+    , position_independent_code(descriptor.position_independent_code)
+    , block_cache(block_cache) {
+  // Compiled code polls the request word with a plain 32-bit load,
+  // which on x86_64 has acquire semantics.
+  static_assert(std::atomic<u32>::is_always_lock_free && sizeof(std::atomic<u32>) == sizeof(u32));
+
   DevirtualizeMemoryReadWriteMethods();
   CreateCodeGenerator();
   EmitCallBlock();
+  EmitDispatchMissHandler();
+  call_block_size = code->getSize();
 }
 
 X64Backend::~X64Backend() {
@@ -55,16 +55,52 @@ void X64Backend::DevirtualizeMemoryReadWriteMethods() {
   write_word_call = Dynarmic::Backend::X64::Devirtualize<&Memory::WriteWord>(&memory);
 }
 
+void X64Backend::InitializeContext(Context& context, CPU::Descriptor const& descriptor) {
+  using Dynarmic::Backend::X64::Devirtualize;
+
+  auto& memory = descriptor.memory;
+
+  auto to_call = [](Dynarmic::Backend::X64::DevirtualizedCall const& call) {
+    return Context::Call{call.fn, call.arg};
+  };
+
+  context.block_cache = block_cache.entry_points;
+  context.pagetable = memory.pagetable ? memory.pagetable->data() : nullptr;
+  context.itcm = &memory.itcm;
+  context.dtcm = &memory.dtcm;
+
+  context.read_byte = to_call(Devirtualize<&Memory::ReadByte>(&memory));
+  context.read_half = to_call(Devirtualize<&Memory::ReadHalf>(&memory));
+  context.read_word = to_call(Devirtualize<&Memory::ReadWord>(&memory));
+
+  context.write_byte = to_call(Devirtualize<&Memory::WriteByte>(&memory));
+  context.write_half = to_call(Devirtualize<&Memory::WriteHalf>(&memory));
+  context.write_word = to_call(Devirtualize<&Memory::WriteWord>(&memory));
+
+  for (int id = 0; id < 16; id++) {
+    auto coprocessor = descriptor.coprocessors[id];
+
+    if (coprocessor != nullptr) {
+      context.coprocessor_read[id] = to_call(Devirtualize<&Coprocessor::Read>(coprocessor));
+      context.coprocessor_write[id] = to_call(Devirtualize<&Coprocessor::Write>(coprocessor));
+    }
+  }
+}
+
 void X64Backend::CreateCodeGenerator() {
   code_memory_block = new memory::CodeBlockMemory(kCodeBufferSize);
   is_writeable = true;
   code = new Xbyak::CodeGenerator{kCodeBufferSize, code_memory_block->GetPointer()};
+  executable_offset = (u8*)code_memory_block->GetExecutablePointer() - (u8*)code_memory_block->GetPointer();
 }
 
 void X64Backend::EmitCallBlock() {
   auto stack_displacement = sizeof(u64) + X64RegisterAllocator::kSpillAreaSize * sizeof(u32);
+  auto context_slot = X64RegisterAllocator::kSpillAreaSize * sizeof(u32);
+  auto label_enter = Xbyak::Label{};
+  auto label_exit = Xbyak::Label{};
 
-  CallBlock = (int (*)(BasicBlock::CompiledFn, int))code->getCurr();
+  CallBlock = (int (*)(BasicBlock::CompiledFn, int, Context*))GetExecutableAddress(code->getCurr());
 
   Push(*code, {rbx, rbp, r12, r13, r14, r15});
 #ifdef ABI_MSVC
@@ -74,16 +110,43 @@ void X64Backend::EmitCallBlock() {
   code->mov(rbp, rsp);
 
   code->mov(r12, kRegArg0); // r12 = function pointer
-  code->mov(rbx, kRegArg1); // rbx = cycle counter
+  code->movsxd(rbx, kRegArg1.cvt32()); // rbx = cycle counter
+  code->mov(rcx, kRegArg2); // rcx = pointer to guest state
+
+  // The pointer to the guest state does not survive calls into the dispatcher.
+  code->mov(qword[rbp + context_slot], rcx);
+
+  code->L(label_enter);
 
   // Load carry flag into AH
-  code->mov(rcx, uintptr(&state));
-  code->mov(edx, dword[rcx + state.GetOffsetToCPSR()]);
+  code->mov(edx, dword[rcx + State::GetOffsetToCPSR()]);
   code->bt(edx, 29); // CF = value of bit 29
   code->lahf();
   
   code->call(r12);
 
+  /* The basic block returned to the dispatcher, because it ran out of cycles, an IRQ or request
+   * is pending or the block cache lookup missed. Unless the cycles ran out, let the dispatcher
+   * handle it and continue with the basic block it returns, without returning from CallBlock.
+   */
+  code->cmp(rbx, 0);
+  code->jle(label_exit);
+  code->mov(rax, qword[rcx + offsetof(Context, dispatch) + offsetof(Context::Call, fn)]);
+  code->mov(kRegArg0, qword[rcx + offsetof(Context, dispatch) + offsetof(Context::Call, arg)]);
+#ifdef ABI_MSVC
+  code->sub(rsp, 0x20);
+  code->call(rax);
+  code->add(rsp, 0x20);
+#else
+  code->call(rax);
+#endif
+  code->mov(rcx, qword[rbp + context_slot]);
+  code->mov(r12, rax);
+  code->test(rax, rax);
+  code->jnz(label_enter);
+
+  code->L(label_exit);
+
   // Return remaining number of cycles
   code->mov(rax, rbx);
 
@@ -95,15 +158,16 @@ void X64Backend::EmitCallBlock() {
   code->ret();
 
 #if LUNATIC_USE_VTUNE
-  vtune::ReportCallBlock(reinterpret_cast<u8*>(CallBlock), code->getCurr());
+  vtune::ReportCallBlock(reinterpret_cast<u8*>(CallBlock), (u8*)GetExecutableAddress(code->getCurr()));
+#endif
+
+#if LUNATIC_USE_PERF
+  perf::ReportCallBlock(reinterpret_cast<u8*>(CallBlock), (u8*)GetExecutableAddress(code->getCurr()));
 #endif
 }
 
 void X64Backend::Compile(BasicBlock& basic_block) {
-  if (!is_writeable) {
-    code_memory_block->ProtectForWrite();
-    is_writeable = true;
-  }
+  ProtectForWrite();
 
   const auto& branch_target = basic_block.branch_target;
   const bool have_conditional_branch = branch_target.key && branch_target.condition != Condition::AL;
@@ -112,26 +176,66 @@ void X64Backend::Compile(BasicBlock& basic_block) {
     auto label_return_to_dispatch = Xbyak::Label{};
     auto opcode_size = basic_block.key.Thumb() ? sizeof(u16) : sizeof(u32);
 
-    basic_block.function = (BasicBlock::CompiledFn) code->getCurr();
+    basic_block.function = GetExecutableAddress(code->getCurr());
+    basic_block.host_mapping.clear();
+
+    // Set while eax holds the flags decompressed from the CPSR, so that consecutive micro blocks can reuse them.
+    bool flags_loaded = false;
 
     for(const auto& micro_block : basic_block.micro_blocks) {
       auto &emitter = micro_block.emitter;
       auto condition = micro_block.condition;
       auto reg_alloc = X64RegisterAllocator{emitter, *code};
-      auto context = CompileContext{*code, reg_alloc, state};
+      auto context = CompileContext{*code, reg_alloc};
 
       auto label_skip = Xbyak::Label{};
       auto label_done = Xbyak::Label{};
 
-      // Skip past the micro block if its condition is not met
-      EmitConditionalBranch(condition, label_skip);
+      // The micro block with the conditional branch must jump to the branch target only if the condition is met.
+      bool branchless = CanCompileBranchless(micro_block) &&
+        !(&micro_block == &basic_block.micro_blocks.back() && have_conditional_branch);
+
+      if (condition != Condition::AL && !flags_loaded) {
+        EmitLoadFlags();
+      }
+
+      if (branchless) {
+        // Stores to guest registers must not be folded, so that they can be made conditional.
+        folded_ops.assign(emitter.Code().size(), nullptr);
+      } else {
+        // Skip past the micro block if its condition is not met
+        EmitConditionalBranch(condition, label_skip);
+
+        FoldIROps(emitter, reg_alloc);
+      }
 
       // Compile each IR opcode inside the micro block
+      int location = 0;
+
       for(auto const &op: emitter.Code()) {
-        CompileIROp(context, op);
+        auto& host_mapping = basic_block.host_mapping;
+        auto folded_op = folded_ops[location++];
+
+        if (host_mapping.empty() || host_mapping.back().guest_address != op->guest_address) {
+          auto host_offset = code->getCurr<u8*>() - GetWritableAddress(basic_block.function);
+
+          host_mapping.push_back({u32(host_offset), op->guest_address});
+        }
+
+        if (branchless && op->GetClass() == IROpcodeClass::StoreGPR) {
+          CompileConditionalStoreGPR(
+            context, lunatic_cast<IRStoreGPR>(op.get()), condition, micro_block.length * opcode_size);
+        } else if (folded_op == nullptr) {
+          CompileIROp(context, op);
+        } else if (folded_op != op.get()) {
+          CompileFoldedOp(context, op.get(), folded_op);
+        }
         reg_alloc.AdvanceLocation();
       }
 
+      // A branchless micro block leaves the host flags and the CPSR untouched.
+      flags_loaded = branchless;
+
       /* If the basic block ends in a conditional branch then emit code to handle
        * block linking right at the end of the ending micro block, so that the
        * block linking will automatically only execute if the branch condition is true.
@@ -140,19 +244,19 @@ void X64Backend::Compile(BasicBlock& basic_block) {
         // Return to the JIT main loop if we ran out of cycles or an IRQ was requested.
         EmitReturnToDispatchIfNeeded(basic_block, label_return_to_dispatch);
 
-        EmitBlockLinkingEpilogue(basic_block);
+        EmitBlockLinkingEpilogue(basic_block, basic_block.branch_target);
       }
 
       /* The program counter is normally updated via IR opcodes.
        * But if we skipped past the code which'd do that, we need to manually
        * update the program counter.
        */
-      if(condition != Condition::AL) {
+      if(condition != Condition::AL && !branchless) {
         code->jmp(label_done);
 
         code->L(label_skip);
         code->add(
-          dword[rcx + state.GetOffsetToGPR(Mode::User, GPR::PC)],
+          dword[rcx + State::GetOffsetToGPR(Mode::User, GPR::PC)],
           micro_block.length * opcode_size
         );
 
@@ -164,10 +268,15 @@ void X64Backend::Compile(BasicBlock& basic_block) {
       // Return to the JIT main loop if we ran out of cycles or an IRQ was requested.
       EmitReturnToDispatchIfNeeded(basic_block, label_return_to_dispatch);
 
+      auto& fallthrough_target = basic_block.fallthrough_target;
+
       if(branch_target.key && branch_target.condition == Condition::AL) {
-        EmitBlockLinkingEpilogue(basic_block);
+        EmitBlockLinkingEpilogue(basic_block, basic_block.branch_target);
+      } else if(have_conditional_branch && fallthrough_target.key && fallthrough_target.key != branch_target.key) {
+        // The branch was not taken, link to the next basic block as well.
+        EmitBlockLinkingEpilogue(basic_block, fallthrough_target);
       } else {
-        EmitBasicBlockDispatch(label_return_to_dispatch);
+        EmitBasicBlockDispatch();
       }
 
       code->L(label_return_to_dispatch);
@@ -177,21 +286,27 @@ void X64Backend::Compile(BasicBlock& basic_block) {
       code->ret();
     }
 
+    basic_block.function_size = code->getCurr<u8*>() - GetWritableAddress(basic_block.function);
+
     Link(basic_block);
 
-    basic_block.RegisterReleaseCallback([this](BasicBlock const& basic_block) {
+    basic_block.RegisterReleaseCallback([this](BasicBlock& basic_block) {
       OnBasicBlockToBeDeleted(basic_block);
     });
 
 #if LUNATIC_USE_VTUNE
-    vtune::ReportBasicBlock(basic_block, code->getCurr());
+    vtune::ReportBasicBlock(basic_block, (u8*)GetExecutableAddress(code->getCurr()));
+#endif
+
+#if LUNATIC_USE_PERF
+    perf::ReportBasicBlock(basic_block, (u8*)GetExecutableAddress(code->getCurr()));
 #endif
   } catch (Xbyak::Error error) {
     if (int(error) == Xbyak::ERR_CODE_IS_TOO_BIG) {
       fmt::print("FLUSH\n");
+      statistics.flushes++;
       block_cache.Flush();
-      code->resetSize();
-      EmitCallBlock();
+      code->setSize(call_block_size);
       Compile(basic_block);
     } else {
       throw;
@@ -199,23 +314,159 @@ void X64Backend::Compile(BasicBlock& basic_block) {
   }
 }
 
-int X64Backend::Call(BasicBlock const& basic_block, int max_cycles) {
+bool X64Backend::Serialize(BasicBlock const& basic_block, std::vector<u8>& buffer) {
+  if (!position_independent_code) {
+    return false;
+  }
+
+  auto function = GetWritableAddress(basic_block.function);
+  BasicBlock::BranchTarget const* targets[] = {&basic_block.branch_target, &basic_block.fallthrough_target};
+  u32 patch_offsets[2];
+
+  for (int i = 0; i < 2; i++) {
+    auto patch_location = targets[i]->patch_location;
+
+    patch_offsets[i] = patch_location ? u32(patch_location - function) : ~0U;
+  }
+
+  auto offset = buffer.size();
+
+  buffer.resize(offset + sizeof(patch_offsets) + basic_block.function_size);
+  std::memcpy(&buffer[offset], patch_offsets, sizeof(patch_offsets));
+  offset += sizeof(patch_offsets);
+  std::memcpy(&buffer[offset], function, basic_block.function_size);
+
+  // Replace the jumps to the branch targets by the padding, which Link() expects to patch.
+  for (auto patch_offset : patch_offsets) {
+    if (patch_offset != ~0U) {
+      std::memcpy(&buffer[offset + patch_offset], kBlockLinkingNops, sizeof(kBlockLinkingNops));
+    }
+  }
+
+  return true;
+}
+
+bool X64Backend::IsValidSerialization(u8 const* data, size_t size) const {
+  u32 patch_offsets[2];
+
+  if (size < sizeof(patch_offsets)) {
+    return false;
+  }
+
+  std::memcpy(patch_offsets, data, sizeof(patch_offsets));
+  size -= sizeof(patch_offsets);
+
+  // Link() and OnBasicBlockToBeDeleted() patch five bytes at each offset.
+  for (auto patch_offset : patch_offsets) {
+    if (patch_offset != ~0U && (patch_offset > size || size - patch_offset < sizeof(kBlockLinkingNops))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void X64Backend::Deserialize(BasicBlock& basic_block, u8 const* data, size_t size) {
+  ProtectForWrite();
+
+  u32 patch_offsets[2];
+
+  std::memcpy(patch_offsets, data, sizeof(patch_offsets));
+  data += sizeof(patch_offsets);
+  size -= sizeof(patch_offsets);
+
+  try {
+    basic_block.function = GetExecutableAddress(code->getCurr());
+    basic_block.function_size = size;
+
+    for (size_t i = 0; i < size; i++) {
+      code->db(data[i]);
+    }
+
+    BasicBlock::BranchTarget* targets[] = {&basic_block.branch_target, &basic_block.fallthrough_target};
+
+    for (int i = 0; i < 2; i++) {
+      auto& target = *targets[i];
+
+      if (patch_offsets[i] == ~0U) {
+        continue;
+      }
+
+      target.patch_location = GetWritableAddress(basic_block.function) + patch_offsets[i];
+      target.MoveTo(block_linking_table[target.key]);
+
+      if (target.key != basic_block.key) {
+        auto target_block = block_cache.Get(target.key);
+
+        if (target_block) {
+          Link(*target_block);
+        }
+      }
+    }
+
+    Link(basic_block);
+
+    basic_block.RegisterReleaseCallback([this](BasicBlock& basic_block) {
+      OnBasicBlockToBeDeleted(basic_block);
+    });
+
+#if LUNATIC_USE_VTUNE
+    vtune::ReportBasicBlock(basic_block, (u8*)GetExecutableAddress(code->getCurr()));
+#endif
+
+#if LUNATIC_USE_PERF
+    perf::ReportBasicBlock(basic_block, (u8*)GetExecutableAddress(code->getCurr()));
+#endif
+  } catch (Xbyak::Error error) {
+    if (int(error) == Xbyak::ERR_CODE_IS_TOO_BIG) {
+      fmt::print("FLUSH\n");
+      statistics.flushes++;
+      block_cache.Flush();
+      code->setSize(call_block_size);
+      Deserialize(basic_block, data - sizeof(patch_offsets), size + sizeof(patch_offsets));
+    } else {
+      throw;
+    }
+  }
+}
+
+int X64Backend::Call(BasicBlock const& basic_block, Context& context, int max_cycles) {
+  ProtectForExecute();
+
+  return CallBlock(basic_block.function, max_cycles, &context);
+}
+
+auto X64Backend::GetEntryPoint(BasicBlock const& basic_block) -> BasicBlock::CompiledFn {
+  // The dispatcher may just have compiled the basic block.
+  ProtectForExecute();
+
+  return basic_block.function;
+}
+
+void X64Backend::ProtectForWrite() {
+  if (!is_writeable) {
+    code_memory_block->ProtectForWrite();
+    is_writeable = true;
+  }
+}
+
+void X64Backend::ProtectForExecute() {
   if (is_writeable) {
     code_memory_block->ProtectForExecute();
     code_memory_block->Invalidate();
     is_writeable = false;
   }
-
-  return CallBlock(basic_block.function, max_cycles);
 }
 
-void X64Backend::EmitConditionalBranch(Condition condition, Xbyak::Label& label_skip) {
-  if (condition == Condition::AL) {
-    return;
-  }
+auto X64Backend::GetStatistics() const -> Statistics {
+  auto result = statistics;
 
-  // TODO: Keep decompressed flags in eax?
-  code->mov(eax, dword[rcx + state.GetOffsetToCPSR()]);
+  result.code_buffer_bytes = code->getSize();
+  return result;
+}
+
+void X64Backend::EmitLoadFlags() {
+  code->mov(eax, dword[rcx + State::GetOffsetToCPSR()]);
   code->shr(eax, 28);
 
 #ifdef LUNATIC_SUPPORT_BMI
@@ -225,73 +476,138 @@ void X64Backend::EmitConditionalBranch(Condition condition, Xbyak::Label& label_
   code->imul(eax, eax, 0x1081);
   code->and_(eax, 0xC101);
 #endif
+}
 
+void X64Backend::EmitTestCondition(Condition condition) {
   switch (condition) {
     case Condition::EQ:
-      code->sahf();
-      code->jnz(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::NE:
-      code->sahf();
-      code->jz(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::CS:
-      code->sahf();
-      code->jnc(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::CC:
-      code->sahf();
-      code->jc(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::MI:
-      code->sahf();
-      code->jns(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::PL:
       code->sahf();
-      code->js(label_skip, Xbyak::CodeGenerator::T_NEAR);
       break;
     case Condition::VS:
-      code->cmp(al, 0x81);
-      code->jno(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::VC:
       code->cmp(al, 0x81);
-      code->jo(label_skip, Xbyak::CodeGenerator::T_NEAR);
       break;
     case Condition::HI:
-      code->sahf();
-      code->cmc();
-      code->jna(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::LS:
       code->sahf();
       code->cmc();
-      code->ja(label_skip, Xbyak::CodeGenerator::T_NEAR);
       break;
     case Condition::GE:
-      code->cmp(al, 0x81);
-      code->sahf();
-      code->jnge(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::LT:
-      code->cmp(al, 0x81);
-      code->sahf();
-      code->jnl(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::GT:
-      code->cmp(al, 0x81);
-      code->sahf();
-      code->jng(label_skip, Xbyak::CodeGenerator::T_NEAR);
-      break;
     case Condition::LE:
       code->cmp(al, 0x81);
       code->sahf();
-      code->jnle(label_skip, Xbyak::CodeGenerator::T_NEAR);
       break;
-    case Condition::NV:
-      code->jmp(label_skip, Xbyak::CodeGenerator::T_NEAR);
+    default:
       break;
+  }
+}
+
+void X64Backend::EmitConditionalMove(Condition condition, Xbyak::Reg32 const& dst, Xbyak::Reg32 const& src) {
+  EmitTestCondition(condition);
+
+  switch (condition) {
+    case Condition::EQ: code->cmovz(dst, src); break;
+    case Condition::NE: code->cmovnz(dst, src); break;
+    case Condition::CS: code->cmovc(dst, src); break;
+    case Condition::CC: code->cmovnc(dst, src); break;
+    case Condition::MI: code->cmovs(dst, src); break;
+    case Condition::PL: code->cmovns(dst, src); break;
+    case Condition::VS: code->cmovo(dst, src); break;
+    case Condition::VC: code->cmovno(dst, src); break;
+    case Condition::HI: code->cmova(dst, src); break;
+    case Condition::LS: code->cmovbe(dst, src); break;
+    case Condition::GE: code->cmovge(dst, src); break;
+    case Condition::LT: code->cmovl(dst, src); break;
+    case Condition::GT: code->cmovg(dst, src); break;
+    case Condition::LE: code->cmovle(dst, src); break;
+    default: {
+      fmt::print("Unsupported Condition {}\n", (int)condition);
+      std::abort();
+    }
+  }
+}
+
+bool X64Backend::CanCompileBranchless(BasicBlock::MicroBlock const& micro_block) {
+  static constexpr size_t kMaxBranchlessOpcodes = 8;
+
+  auto const& code = micro_block.emitter.Code();
+  int pc_stores = 0;
+
+  if (micro_block.condition == Condition::AL ||
+      micro_block.condition == Condition::NV ||
+      code.size() > kMaxBranchlessOpcodes) {
+    return false;
+  }
+
+  // Opcodes must not have side effects other than guest register stores and must not update the host flags.
+  for (auto const& op : code) {
+    switch (op->GetClass()) {
+      case IROpcodeClass::NOP:
+      case IROpcodeClass::LoadGPR:
+      case IROpcodeClass::CLZ: {
+        break;
+      }
+      case IROpcodeClass::StoreGPR: {
+        if (lunatic_cast<IRStoreGPR>(op.get())->reg.reg == GPR::PC) {
+          pc_stores++;
+        }
+        break;
+      }
+      case IROpcodeClass::LSL: if (lunatic_cast<IRLogicalShiftLeft>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::LSR: if (lunatic_cast<IRLogicalShiftRight>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::ASR: if (lunatic_cast<IRArithmeticShiftRight>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::ROR: if (lunatic_cast<IRRotateRight>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::AND: if (lunatic_cast<IRBitwiseAND>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::BIC: if (lunatic_cast<IRBitwiseBIC>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::EOR: if (lunatic_cast<IRBitwiseEOR>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::SUB: if (lunatic_cast<IRSub>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::RSB: if (lunatic_cast<IRRsb>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::ADD: if (lunatic_cast<IRAdd>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::ORR: if (lunatic_cast<IRBitwiseORR>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::MOV: if (lunatic_cast<IRMov>(op.get())->update_host_flags) return false; break;
+      case IROpcodeClass::MVN: if (lunatic_cast<IRMvn>(op.get())->update_host_flags) return false; break;
+      default: {
+        return false;
+      }
+    }
+  }
+
+  /* On the skipped path the program counter is advanced past the micro block.
+   * This is only done once, when the micro block writes the program counter.
+   */
+  return pc_stores == 1;
+}
+
+void X64Backend::EmitConditionalBranch(Condition condition, Xbyak::Label& label_skip) {
+  if (condition == Condition::AL) {
+    return;
+  }
+
+  EmitTestCondition(condition);
+
+  switch (condition) {
+    case Condition::EQ: code->jnz(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::NE: code->jz(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::CS: code->jnc(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::CC: code->jc(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::MI: code->jns(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::PL: code->js(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::VS: code->jno(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::VC: code->jo(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::HI: code->jna(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::LS: code->ja(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::GE: code->jnge(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::LT: code->jnl(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::GT: code->jng(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::LE: code->jnle(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
+    case Condition::NV: code->jmp(label_skip, Xbyak::CodeGenerator::T_NEAR); break;
     default:
       fmt::print("Unsupported Condition {}\n", (int)condition);
       std::abort();
@@ -304,16 +620,31 @@ void X64Backend::EmitReturnToDispatchIfNeeded(BasicBlock& basic_block, Xbyak::La
   code->jle(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
 
   // Return to the dispatcher if there is an IRQ to handle
-  code->mov(rdx, uintptr(&irq_line));
-  code->cmp(byte[rdx], 0);
-  code->jnz(label_return_to_dispatch);
+  code->cmp(byte[rcx + State::GetOffsetToIRQLine()], 0);
+  code->jnz(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
+
+  // Return to the dispatcher if another thread posted a request
+  code->cmp(dword[rcx + State::GetOffsetToRequests()], 0);
+  code->jnz(label_return_to_dispatch, Xbyak::CodeGenerator::T_NEAR);
+}
+
+void X64Backend::EmitDispatchMissHandler() {
+  auto dispatch_miss_handler = GetExecutableAddress(code->getCurr());
+
+  /* Basic blocks jump here if the block cache has no basic block for the next key.
+   * Return to the dispatcher in CallBlock, which will compile the basic block.
+   */
+  code->inc(qword[rcx + offsetof(Context, dispatch_misses)]);
+  code->ret();
+
+  block_cache.SetDispatchMissHandler(dispatch_miss_handler);
 }
 
-void X64Backend::EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss) {
+void X64Backend::EmitBasicBlockDispatch() {
   // Build the block key from R15 and CPSR.
   // See frontend/basic_block.hpp
-  code->mov(edx, dword[rcx + state.GetOffsetToGPR(Mode::User, GPR::PC)]);
-  code->mov(esi, dword[rcx + state.GetOffsetToCPSR()]);
+  code->mov(edx, dword[rcx + State::GetOffsetToGPR(Mode::User, GPR::PC)]);
+  code->mov(esi, dword[rcx + State::GetOffsetToCPSR()]);
   code->shr(edx, 1);
   code->and_(esi, 0x3F);
   code->shl(rsi, 31);
@@ -322,55 +653,79 @@ void X64Backend::EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss) {
   // Hash0 lookup (first level)
   code->mov(rsi, rdx);
   code->shr(rsi, 19);
-  code->mov(rdi, uintptr(block_cache.data));
+  if (position_independent_code) {
+    code->mov(rdi, qword[rcx + offsetof(Context, block_cache)]);
+  } else {
+    code->mov(rdi, uintptr(block_cache.entry_points));
+  }
   code->mov(rdi, qword[rdi + rsi * sizeof(uintptr)]);
-  code->test(rdi, rdi);
-  code->jz(label_cache_miss);
 
-  // Hash1 lookup (second level)
+  // Hash1 lookup (second level), which yields the dispatch miss handler for empty slots.
   code->and_(edx, 0x7FFFF);
   code->mov(rdi, qword[rdi + rdx * sizeof(uintptr)]);
-  code->test(rdi, rdi);
-  code->jz(label_cache_miss);
-  code->mov(rdi, qword[rdi + offsetof(BasicBlock, function)]);
 
   // Load carry flag into AH
-  code->mov(edx, dword[rcx + state.GetOffsetToCPSR()]);
+  code->mov(edx, dword[rcx + State::GetOffsetToCPSR()]);
   code->bt(edx, 29); // CF = value of bit 29
   code->lahf();
 
   code->jmp(rdi);
 }
 
-void X64Backend::EmitBlockLinkingEpilogue(BasicBlock& basic_block) {
-  auto& branch_target = basic_block.branch_target;
-
+void X64Backend::EmitBlockLinkingEpilogue(BasicBlock& basic_block, BasicBlock::BranchTarget& target) {
   BasicBlock* target_block;
 
-  if (branch_target.key == basic_block.key) {
+  if (basic_block.is_idle_loop && target.key == basic_block.key) {
+    /* Running the loop again would not change the guest state,
+     * so consume all remaining cycles and let the embedder know.
+     */
+    code->xor_(ebx, ebx);
+    code->mov(byte[rcx + State::GetOffsetToIdleLoopFlag()], 1);
+    code->ret();
+    return;
+  }
+
+  if (target.key == basic_block.key) {
     target_block = &basic_block;
   } else {
-    target_block = block_cache.Get(branch_target.key);
+    target_block = block_cache.Get(target.key);
   }
 
+  /* Memorize the location of the jump to the branch target, so that a relative jump
+   * can be patched in once the branch target has been compiled, or the code is serialized.
+   */
+  target.patch_location = code->getCurr<u8*>();
+
   if (target_block) {
     // The branch target is already compiled, emit a relative jump to it now.
-    code->jmp((const void*)target_block->function);
+    code->jmp(GetWritableAddress(target_block->function), Xbyak::CodeGenerator::T_NEAR);
+    code->ret(); // keep the layout identical to the padding below.
 
-    target_block->linking_blocks.push_back(&basic_block);
+    target.MoveTo(target_block->incoming_links);
   } else {
-    /* The branch target has not been compiled yet.
-     * Create a padding of 5 NOPs and memorize its address, so that a relative jump
-     * can be patched in once the branch target has been compiled.
-     */
-    branch_target.patch_location = code->getCurr<u8*>();
-    code->nop(5);
+    // The branch target has not been compiled yet, create a padding of 5 NOPs.
+    code->db(kBlockLinkingNops, sizeof(kBlockLinkingNops));
     code->ret(); // avoid subtracting the cycle count twice.
 
     /* Memorize that this basic block should link to the branch target,
      * so that we know which blocks to patch once the branch target has been compiled.
      */
-    block_linking_table[branch_target.key].push_back(&basic_block);
+    target.MoveTo(block_linking_table[target.key]);
+  }
+}
+
+void X64Backend::EmitLoadCallTarget(
+  Xbyak::CodeGenerator& code,
+  Dynarmic::Backend::X64::DevirtualizedCall const& call,
+  uintptr context_offset
+) {
+  // Load RAX before the first argument, which may alias RCX.
+  if (position_independent_code) {
+    code.mov(rax, qword[rcx + context_offset + offsetof(Context::Call, fn)]);
+    code.mov(kRegArg0, qword[rcx + context_offset + offsetof(Context::Call, arg)]);
+  } else {
+    code.mov(rax, call.fn);
+    code.mov(kRegArg0, call.arg);
   }
 }
 
@@ -381,50 +736,86 @@ void X64Backend::Link(BasicBlock& basic_block) {
     return;
   }
 
-  for (auto linking_block : iterator->second) {
-    u8* patch = linking_block->branch_target.patch_location;
-    u32 relative_address = (u32)((s64)basic_block.function - (s64)patch - 5LL);
+  auto& waiting_links = iterator->second;
+
+  while (!waiting_links.IsEmpty()) {
+    auto target = static_cast<BasicBlock::BranchTarget*>(waiting_links.next);
+    u8* patch = target->patch_location;
+    u32 relative_address = (u32)((s64)GetWritableAddress(basic_block.function) - (s64)patch - 5LL);
 
     patch[0] = 0xE9;
     patch[1] = (u8)(relative_address >>  0);
     patch[2] = (u8)(relative_address >>  8);
     patch[3] = (u8)(relative_address >> 16);
     patch[4] = (u8)(relative_address >> 24);
+    code_memory_block->Invalidate((void const*)GetExecutableAddress(patch), 5);
+
+    statistics.link_patches++;
 
-    basic_block.linking_blocks.push_back(linking_block);
+    target->MoveTo(basic_block.incoming_links);
   }
 
   block_linking_table.erase(iterator);
 }
 
-void X64Backend::OnBasicBlockToBeDeleted(BasicBlock const& basic_block) {
+void X64Backend::OnBasicBlockToBeDeleted(BasicBlock& basic_block) {
   // TODO: release the allocated JIT buffer memory.
 
-  auto const& branch_target = basic_block.branch_target;
-
-  // Do not leave a dangling pointer to the block in the block linking table or the target block.
-  if (!branch_target.key.IsEmpty()) {
-    auto iterator = block_linking_table.find(branch_target.key);
+  // Remove the jumps of the block from the incoming links of their targets or the block linking table.
+  for (auto target : {&basic_block.branch_target, &basic_block.fallthrough_target}) {
+    target->Unlink();
 
-    if (iterator != block_linking_table.end()) {
-      auto& linking_blocks = iterator->second;
+    auto iterator = block_linking_table.find(target->key);
 
-      linking_blocks.erase(std::find(
-        linking_blocks.begin(), linking_blocks.end(), &basic_block));
+    if (iterator != block_linking_table.end() && iterator->second.IsEmpty()) {
+      block_linking_table.erase(iterator);
     }
+  }
 
-    auto target_block = block_cache.Get(branch_target.key);
+  auto& incoming_links = basic_block.incoming_links;
 
-    if (target_block) {
-      auto& linking_blocks = target_block->linking_blocks;
+  if (incoming_links.IsEmpty()) {
+    return;
+  }
 
-      auto iterator = std::find(
-        linking_blocks.begin(), linking_blocks.end(), &basic_block);
+  // Patch the padding back into the jumps to the block, so that their blocks return to the dispatcher instead.
+  BeginRelease();
+  ProtectForWrite();
 
-      if (iterator != linking_blocks.end()) {
-        linking_blocks.erase(iterator);
-      }
-    }
+  auto& waiting_links = block_linking_table[basic_block.key];
+
+  while (!incoming_links.IsEmpty()) {
+    auto target = static_cast<BasicBlock::BranchTarget*>(incoming_links.next);
+
+    std::memcpy(target->patch_location, kBlockLinkingNops, sizeof(kBlockLinkingNops));
+    code_memory_block->Invalidate((void const*)GetExecutableAddress(target->patch_location), sizeof(kBlockLinkingNops));
+    target->MoveTo(waiting_links);
+  }
+
+  // Link the jumps right away, if the block has been replaced by a new block.
+  auto new_block = block_cache.Get(basic_block.key);
+
+  if (new_block != nullptr && new_block != &basic_block) {
+    Link(*new_block);
+  }
+
+  EndRelease();
+}
+
+void X64Backend::BeginRelease() {
+  if (release_depth++ == 0) {
+    was_writeable_before_release = is_writeable;
+  }
+}
+
+/* Compiled code may release blocks (for example by invalidating the instruction cache from a coprocessor write),
+ * so the code must be made executable again, unless it was writeable already. The patched jumps have been
+ * invalidated one by one, so unlike ProtectForExecute() this does not invalidate the whole code buffer.
+ */
+void X64Backend::EndRelease() {
+  if (--release_depth == 0 && is_writeable && !was_writeable_before_release) {
+    code_memory_block->ProtectForExecute();
+    is_writeable = false;
   }
 }
 
@@ -494,6 +885,39 @@ void X64Backend::CompileIROp(
   }
 }
 
+void X64Backend::FoldIROps(
+  IREmitter const& emitter,
+  X64RegisterAllocator& reg_alloc
+) {
+  number_of_reads.assign(emitter.Vars().size(), 0);
+  folded_ops.assign(emitter.Code().size(), nullptr);
+
+  for (auto const& op : emitter.Code()) {
+    for (auto var : op->GetReads()) {
+      number_of_reads[var->id]++;
+    }
+  }
+
+  FoldShiftsIntoADD(emitter, reg_alloc);
+  FoldGPRAccesses(emitter);
+}
+
+void X64Backend::CompileFoldedOp(
+  CompileContext const& context,
+  IROpcode* op,
+  IROpcode* folded_op
+) {
+  switch (folded_op->GetClass()) {
+    case IROpcodeClass::LSL: CompileShiftedADD(context, lunatic_cast<IRAdd>(op), lunatic_cast<IRLogicalShiftLeft>(folded_op)); break;
+    case IROpcodeClass::LoadGPR: CompileFoldedGPRAccess(context, op); break;
+    default: {
+      throw std::runtime_error(
+        fmt::format("lunatic: unhandled folded IR opcode: {}", folded_op->ToString())
+      );
+    }
+  }
+}
+
 void X64Backend::Push(
   Xbyak::CodeGenerator& code,
   std::vector<Xbyak::Reg64> const& regs
@@ -530,10 +954,8 @@ auto X64Backend::GetUsedHostRegsFromList(
 }
 
 std::unique_ptr<Backend> Backend::CreateBackend(CPU::Descriptor const& descriptor,
-                                                State& state,
-                                                BasicBlockCache& block_cache,
-                                                bool const& irq_line) {
-  return std::make_unique<X64Backend>(descriptor, state, block_cache, irq_line);
+                                                BasicBlockCache& block_cache) {
+  return std::make_unique<X64Backend>(descriptor, block_cache);
 }
 
 } // namespace lunatic::backend
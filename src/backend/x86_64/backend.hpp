@@ -32,44 +32,121 @@ namespace backend {
 struct X64Backend : Backend {
   X64Backend(
     CPU::Descriptor const& descriptor,
-    State& state,
-    BasicBlockCache& block_cache,
-    bool const& irq_line
+    BasicBlockCache& block_cache
   );
 
  ~X64Backend();
 
+  void InitializeContext(Context& context, CPU::Descriptor const& descriptor) override;
   void Compile(BasicBlock& basic_block) override;
-  int Call(frontend::BasicBlock const& basic_block, int max_cycles) override;
+  bool Serialize(BasicBlock const& basic_block, std::vector<u8>& buffer) override;
+  bool IsValidSerialization(u8 const* data, size_t size) const override;
+  void Deserialize(BasicBlock& basic_block, u8 const* data, size_t size) override;
+  int Call(frontend::BasicBlock const& basic_block, Context& context, int max_cycles) override;
+  void BeginRelease() override;
+  void EndRelease() override;
+  auto GetEntryPoint(frontend::BasicBlock const& basic_block) -> BasicBlock::CompiledFn override;
+  auto GetStatistics() const -> Statistics override;
 
 private:
   static constexpr size_t kCodeBufferSize = 32 * 1024 * 1024;
 
+  // Five byte NOP, which is patched into a relative jump once the branch target is compiled.
+  static constexpr u8 kBlockLinkingNops[5] = {0x0F, 0x1F, 0x44, 0x00, 0x00};
+
   struct CompileContext {
     Xbyak::CodeGenerator& code;
     X64RegisterAllocator& reg_alloc;
-    State& state;
   };
 
   void DevirtualizeMemoryReadWriteMethods();
   void CreateCodeGenerator();
+  void ProtectForWrite();
+  void ProtectForExecute();
   void EmitCallBlock();
 
+  // Decompress the NZCV flags from the CPSR into the host flags register (eax).
+  void EmitLoadFlags();
+
+  /* Set the x86 flags from the decompressed host flags, such that the condition
+   * can be checked with a single x86 condition code.
+   */
+  void EmitTestCondition(Condition condition);
+
   void EmitConditionalBranch(Condition condition, Xbyak::Label& label_skip);
+  void EmitConditionalMove(Condition condition, Xbyak::Reg32 const& dst, Xbyak::Reg32 const& src);
 
   void EmitReturnToDispatchIfNeeded(BasicBlock& basic_block, Xbyak::Label& label_return_to_dispatch);
-  void EmitBasicBlockDispatch(Xbyak::Label& label_cache_miss);
-  void EmitBlockLinkingEpilogue(BasicBlock& basic_block);
+  void EmitDispatchMissHandler();
+  void EmitBasicBlockDispatch();
+  void EmitBlockLinkingEpilogue(BasicBlock& basic_block, BasicBlock::BranchTarget& target);
+
+  void EmitLoadCallTarget(
+    Xbyak::CodeGenerator& code,
+    Dynarmic::Backend::X64::DevirtualizedCall const& call,
+    uintptr context_offset
+  );
 
   void Link(BasicBlock& basic_block);
 
-  void OnBasicBlockToBeDeleted(BasicBlock const& basic_block);
+  /* The code buffer may be mapped twice, so that code is written and executed through different addresses.
+   * Pointers into the code buffer are kept as writable addresses, except for BasicBlock::function,
+   * which the dispatcher jumps to.
+   */
+  auto GetExecutableAddress(void const* address) const -> BasicBlock::CompiledFn {
+    return BasicBlock::CompiledFn(address) + executable_offset;
+  }
+
+  auto GetWritableAddress(BasicBlock::CompiledFn address) const -> u8* {
+    return (u8*)(address - executable_offset);
+  }
+
+  void OnBasicBlockToBeDeleted(BasicBlock& basic_block);
 
   void CompileIROp(
     CompileContext const& context,
     std::unique_ptr<IROpcode> const& op
   );
 
+  /**
+   * Find IR opcodes, which are compiled as part of another opcode rather than on their own.
+   * For each location in the micro block, folded_ops holds the opcode folded into the opcode at that location,
+   * or the opcode itself if it is folded into another opcode and thus must not be compiled.
+   */
+  void FoldIROps(
+    IREmitter const& emitter,
+    X64RegisterAllocator& reg_alloc
+  );
+
+  /**
+   * Find left shifts by one to three bits, whose result is only read by an ADD that does not update flags.
+   * The ADD is compiled into a single LEA then, which scales the shift operand in its address computation.
+   */
+  void FoldShiftsIntoADD(
+    IREmitter const& emitter,
+    X64RegisterAllocator& reg_alloc
+  );
+
+  /**
+   * Find guest register loads, whose result is only read by an ALU opcode, which then reads the
+   * guest register from memory. If the ALU result is only stored back to the same guest register,
+   * the store is folded as well and the ALU opcode operates on the guest register in memory.
+   */
+  void FoldGPRAccesses(IREmitter const& emitter);
+
+  void CompileFoldedOp(
+    CompileContext const& context,
+    IROpcode* op,
+    IROpcode* folded_op
+  );
+
+  /**
+   * Check if a conditional micro block is short and only computes values which it writes to guest registers.
+   * Such a micro block is compiled without a branch: its opcodes always execute and
+   * each guest register store selects between the old and the new value with a CMOV.
+   */
+  bool CanCompileBranchless(BasicBlock::MicroBlock const& micro_block);
+
   void Push(
     Xbyak::CodeGenerator& code,
     std::vector<Xbyak::Reg64> const& regs
@@ -87,6 +164,9 @@ private:
 
   void CompileLoadGPR(CompileContext const& context, IRLoadGPR* op);
   void CompileStoreGPR(CompileContext const& context, IRStoreGPR* op);
+  void CompileConditionalStoreGPR(CompileContext const& context, IRStoreGPR* op, Condition condition, u32 pc_increment);
+  void CompileFoldedGPRAccess(CompileContext const& context, IROpcode* op);
+  template<typename T> void CompileFoldedALU(CompileContext const& context, T* op);
   void CompileLoadSPSR(CompileContext const& context, IRLoadSPSR* op);
   void CompileStoreSPSR(CompileContext const& context, IRStoreSPSR* op);
   void CompileLoadCPSR(CompileContext const& context, IRLoadCPSR* op);
@@ -105,6 +185,7 @@ private:
   void CompileSUB(CompileContext const& context, IRSub* op);
   void CompileRSB(CompileContext const& context, IRRsb* op);
   void CompileADD(CompileContext const& context, IRAdd* op);
+  void CompileShiftedADD(CompileContext const& context, IRAdd* op, IRLogicalShiftLeft* shift);
   void CompileADC(CompileContext const& context, IRAdc* op);
   void CompileSBC(CompileContext const& context, IRSbc* op);
   void CompileRSC(CompileContext const& context, IRRsc* op);
@@ -124,17 +205,35 @@ private:
   void CompileMCR(CompileContext const& context, IRWriteCoprocessorRegister* op);
 
   Memory& memory;
-  State& state;
   std::array<Coprocessor*, 16> coprocessors;
+  CPU::Descriptor::Model model;
+  bool position_independent_code;
   BasicBlockCache& block_cache;
-  bool const& irq_line;
-  int (*CallBlock)(BasicBlock::CompiledFn, int);
+  int (*CallBlock)(BasicBlock::CompiledFn, int, Context*);
+
+  // CallBlock() and the dispatch miss handler stay at the start of the code buffer across flushes,
+  // because a flush may happen while CallBlock() calls into the dispatcher.
+  size_t call_block_size;
 
   memory::CodeBlockMemory *code_memory_block;
+  uintptr executable_offset;
   bool is_writeable;
+
+  // Nesting depth of BeginRelease(), and whether the code buffer was writeable at the outermost call.
+  int release_depth = 0;
+  bool was_writeable_before_release = false;
   Xbyak::CodeGenerator* code;
 
-  std::unordered_map<BasicBlock::Key, std::vector<BasicBlock*>> block_linking_table;
+  // Jumps (see BasicBlock::BranchTarget), which wait for the basic block with the key to be compiled.
+  std::unordered_map<BasicBlock::Key, IntrusiveListNode> block_linking_table;
+
+  /// State of FoldIROps() for the current micro block.
+  std::vector<IROpcode*> folded_ops;
+  std::vector<int> number_of_reads;
+  std::vector<IRLoadGPR*> folded_loads;
+  std::vector<IRStoreGPR*> folded_stores;
+
+  Statistics statistics;
 
   Dynarmic::Backend::X64::DevirtualizedCall read_byte_call;
   Dynarmic::Backend::X64::DevirtualizedCall read_half_call;
@@ -9,7 +9,7 @@
 
 #include "backend.hpp"
 
-#define DESTRUCTURE_CONTEXT auto& [code, reg_alloc, state] = context;
+#define DESTRUCTURE_CONTEXT auto& [code, reg_alloc] = context;
 
 using namespace Xbyak::util;
 
@@ -27,10 +27,16 @@ void X64Backend::CompileAND(CompileContext const& context, IRBitwiseAND* op) {
 
       auto result_reg = reg_alloc.GetVariableHostReg(result_var);
 
-      if (result_reg != lhs_reg) {
-        code.mov(result_reg, lhs_reg);
+      if (imm == 0xFF && !op->update_host_flags) {
+        code.movzx(result_reg, lhs_reg.cvt8());
+      } else if (imm == 0xFFFF && !op->update_host_flags) {
+        code.movzx(result_reg, lhs_reg.cvt16());
+      } else {
+        if (result_reg != lhs_reg) {
+          code.mov(result_reg, lhs_reg);
+        }
+        code.and_(result_reg, imm);
       }
-      code.and_(result_reg, imm);
     }
   } else {
     auto& rhs_var = op->rhs.GetVar();
@@ -177,7 +183,12 @@ void X64Backend::CompileSUB(CompileContext const& context, IRSub* op) {
     auto imm = op->rhs.GetConst().value;
 
     if (op->result.IsNull()) {
-      code.cmp(lhs_reg, imm);
+      // TEST sets the same flags as a comparison against zero.
+      if (imm == 0) {
+        code.test(lhs_reg, lhs_reg);
+      } else {
+        code.cmp(lhs_reg, imm);
+      }
     } else {
       auto& result_var = op->result.Unwrap();
 
@@ -185,13 +196,17 @@ void X64Backend::CompileSUB(CompileContext const& context, IRSub* op) {
 
       auto result_reg = reg_alloc.GetVariableHostReg(result_var);
 
-      if (result_reg != lhs_reg) {
-        code.mov(result_reg, lhs_reg);
-      }
-      if(imm == 1u && !update_host_flags) {
-        code.dec(result_reg);
+      if (result_reg != lhs_reg && !update_host_flags) {
+        code.lea(result_reg, ptr[lhs_reg.cvt64() - s32(imm)]);
       } else {
-        code.sub(result_reg, imm);
+        if (result_reg != lhs_reg) {
+          code.mov(result_reg, lhs_reg);
+        }
+        if(imm == 1u && !update_host_flags) {
+          code.dec(result_reg);
+        } else {
+          code.sub(result_reg, imm);
+        }
       }
     }
   } else {
@@ -291,13 +306,18 @@ void X64Backend::CompileADD(CompileContext const& context, IRAdd* op) {
 
       auto result_reg = reg_alloc.GetVariableHostReg(result_var);
 
-      if (result_reg != lhs_reg) {
-        code.mov(result_reg, lhs_reg);
-      }
-      if(imm == 1u && !update_host_flags) {
-        code.inc(result_reg);
+      // LEA adds into a different register without the extra MOV, but cannot set flags.
+      if (result_reg != lhs_reg && !update_host_flags) {
+        code.lea(result_reg, ptr[lhs_reg.cvt64() + s32(imm)]);
       } else {
-        code.add(result_reg, imm);
+        if (result_reg != lhs_reg) {
+          code.mov(result_reg, lhs_reg);
+        }
+        if(imm == 1u && !update_host_flags) {
+          code.inc(result_reg);
+        } else {
+          code.add(result_reg, imm);
+        }
       }
     }
   } else {
@@ -320,6 +340,8 @@ void X64Backend::CompileADD(CompileContext const& context, IRAdd* op) {
         code.add(lhs_reg, rhs_reg);
       } else if (result_reg == rhs_reg) {
         code.add(rhs_reg, lhs_reg);
+      } else if (!update_host_flags) {
+        code.lea(result_reg, ptr[lhs_reg.cvt64() + rhs_reg.cvt64()]);
       } else {
         code.mov(result_reg, lhs_reg);
         code.add(result_reg, rhs_reg);
@@ -333,6 +355,99 @@ void X64Backend::CompileADD(CompileContext const& context, IRAdd* op) {
   }
 }
 
+void X64Backend::FoldShiftsIntoADD(
+  IREmitter const& emitter,
+  X64RegisterAllocator& reg_alloc
+) {
+  auto number_of_vars = emitter.Vars().size();
+  auto var_id_to_shift = std::vector<IRLogicalShiftLeft*>(number_of_vars);
+  auto var_id_to_shift_location = std::vector<int>(number_of_vars);
+  int location = 0;
+
+  for (auto const& op : emitter.Code()) {
+    if (op->GetClass() == IROpcodeClass::LSL) {
+      auto shift = lunatic_cast<IRLogicalShiftLeft>(op.get());
+      auto& amount = shift->amount;
+
+      if (!shift->update_host_flags && amount.IsConstant()) {
+        auto  amount_value = amount.GetConst().value;
+        auto& result_var = shift->result.Get();
+
+        if (amount_value >= 1 && amount_value <= 3) {
+          var_id_to_shift[result_var.id] = shift;
+          var_id_to_shift_location[result_var.id] = location;
+        }
+      }
+    } else if (op->GetClass() == IROpcodeClass::ADD) {
+      auto add = lunatic_cast<IRAdd>(op.get());
+      auto shifted_var = (IRVariable const*)nullptr;
+
+      if (!add->update_host_flags && add->result.HasValue()) {
+        auto can_fold = [&](IRVariable const& var) {
+          return var_id_to_shift[var.id] != nullptr && number_of_reads[var.id] == 1;
+        };
+
+        if (add->rhs.IsVariable() && can_fold(add->rhs.GetVar())) {
+          shifted_var = &add->rhs.GetVar();
+        } else if (can_fold(add->lhs.Get())) {
+          shifted_var = &add->lhs.Get();
+        }
+      }
+
+      if (shifted_var) {
+        auto shift = var_id_to_shift[shifted_var->id];
+
+        folded_ops[var_id_to_shift_location[shifted_var->id]] = shift;
+        folded_ops[location] = shift;
+
+        // The shift operand is now read by the ADD instead of the shift.
+        reg_alloc.ExtendLifetime(shift->operand.Get(), location);
+      }
+    }
+
+    location++;
+  }
+}
+
+void X64Backend::CompileShiftedADD(CompileContext const& context, IRAdd* op, IRLogicalShiftLeft* shift) {
+  DESTRUCTURE_CONTEXT;
+
+  auto& result_var = op->result.Unwrap();
+  auto& index_var = shift->operand.Get();
+  auto  scale = 1 << shift->amount.GetConst().value;
+
+  // The base of the address computation is the ADD operand that is not the shift result.
+  auto base = IRAnyRef{op->lhs.Get()};
+
+  if (&op->lhs.Get() == &shift->result.Get()) {
+    base = op->rhs;
+  }
+
+  if (base.IsConstant()) {
+    auto index_reg = reg_alloc.GetVariableHostReg(index_var);
+
+    reg_alloc.ReleaseVarAndReuseHostReg(index_var, result_var);
+
+    auto result_reg = reg_alloc.GetVariableHostReg(result_var);
+
+    code.lea(result_reg, ptr[index_reg.cvt64() * scale + s32(base.GetConst().value)]);
+  } else {
+    auto& base_var = base.GetVar();
+
+    // Allocate the base first: the index is not an operand of the ADD and thus might be spilled.
+    // This is harmless for the result, because spilling leaves the index value in its register.
+    auto base_reg = reg_alloc.GetVariableHostReg(base_var);
+    auto index_reg = reg_alloc.GetVariableHostReg(index_var);
+
+    reg_alloc.ReleaseVarAndReuseHostReg(base_var, result_var);
+    reg_alloc.ReleaseVarAndReuseHostReg(index_var, result_var);
+
+    auto result_reg = reg_alloc.GetVariableHostReg(result_var);
+
+    code.lea(result_reg, ptr[base_reg.cvt64() + index_reg.cvt64() * scale]);
+  }
+}
+
 void X64Backend::CompileADC(CompileContext const& context, IRAdc* op) {
   DESTRUCTURE_CONTEXT;
 
@@ -5,6 +5,8 @@
  * found in the LICENSE file.
  */
 
+#include <unordered_map>
+
 #include "common.hpp"
 
 namespace lunatic::backend {
@@ -12,7 +14,7 @@ namespace lunatic::backend {
 void X64Backend::CompileLoadGPR(CompileContext const& context, IRLoadGPR* op) {
   DESTRUCTURE_CONTEXT;
 
-  auto address  = rcx + state.GetOffsetToGPR(op->reg.mode, op->reg.reg);
+  auto address  = rcx + State::GetOffsetToGPR(op->reg.mode, op->reg.reg);
   auto host_reg = reg_alloc.GetVariableHostReg(op->result.Get());
 
   code.mov(host_reg, dword[address]);
@@ -21,7 +23,7 @@ void X64Backend::CompileLoadGPR(CompileContext const& context, IRLoadGPR* op) {
 void X64Backend::CompileStoreGPR(CompileContext const& context, IRStoreGPR* op) {
   DESTRUCTURE_CONTEXT;
 
-  auto address = rcx + state.GetOffsetToGPR(op->reg.mode, op->reg.reg);
+  auto address = rcx + State::GetOffsetToGPR(op->reg.mode, op->reg.reg);
 
   if (op->value.IsConstant()) {
     code.mov(dword[address], op->value.GetConst().value);
@@ -32,10 +34,272 @@ void X64Backend::CompileStoreGPR(CompileContext const& context, IRStoreGPR* op)
   }
 }
 
+void X64Backend::CompileConditionalStoreGPR(
+  CompileContext const& context,
+  IRStoreGPR* op,
+  Condition condition,
+  u32 pc_increment
+) {
+  DESTRUCTURE_CONTEXT;
+
+  auto address = rcx + State::GetOffsetToGPR(op->reg.mode, op->reg.reg);
+  auto value_reg = Xbyak::Reg32{};
+
+  if (op->value.IsConstant()) {
+    value_reg = reg_alloc.GetTemporaryHostReg();
+    code.mov(value_reg, op->value.GetConst().value);
+  } else {
+    value_reg = reg_alloc.GetVariableHostReg(op->value.GetVar());
+  }
+
+  auto result_reg = reg_alloc.GetTemporaryHostReg();
+
+  // Keep the old value if the condition is not met. The program counter is advanced past the micro block then.
+  code.mov(result_reg, dword[address]);
+  if (op->reg.reg == GPR::PC) {
+    code.add(result_reg, pc_increment);
+  }
+
+  EmitConditionalMove(condition, result_reg, value_reg);
+  code.mov(dword[address], result_reg);
+}
+
+void X64Backend::FoldGPRAccesses(IREmitter const& emitter) {
+  auto number_of_vars = emitter.Vars().size();
+  auto var_id_to_load = std::vector<IRLoadGPR*>(number_of_vars);
+  auto var_id_to_load_location = std::vector<int>(number_of_vars);
+  auto var_id_to_alu_location = std::vector<int>(number_of_vars, -1);
+  int location = 0;
+
+  // Map the offset of each guest register to the location of the last load and store.
+  auto last_load_location = std::unordered_map<uintptr, int>{};
+  auto last_store_location = std::unordered_map<uintptr, int>{};
+
+  folded_loads.assign(number_of_vars, nullptr);
+  folded_stores.assign(number_of_vars, nullptr);
+
+  auto get_offset = [&](IRGuestReg const& reg) {
+    return State::GetOffsetToGPR(reg.mode, reg.reg);
+  };
+
+  auto get_location = [](std::unordered_map<uintptr, int> const& map, uintptr offset) {
+    auto match = map.find(offset);
+
+    return match != map.end() ? match->second : -1;
+  };
+
+  // The ALU opcode may only read the guest register in memory if it was not written since the load.
+  auto can_fold = [&](IRVariable const& var) {
+    auto load = var_id_to_load[var.id];
+
+    return load != nullptr && number_of_reads[var.id] == 1 &&
+      get_location(last_store_location, get_offset(load->reg)) < var_id_to_load_location[var.id];
+  };
+
+  auto fold = [&](IRVariable const& var) {
+    auto load = var_id_to_load[var.id];
+
+    folded_loads[var.id] = load;
+    folded_ops[var_id_to_load_location[var.id]] = load;
+    folded_ops[location] = load;
+  };
+
+  auto fold_into_alu = [&](auto op) {
+    // The opcode might already be compiled to an LEA.
+    if (folded_ops[location] != nullptr) {
+      return;
+    }
+
+    auto& lhs_var = op->lhs.Get();
+
+    if (op->result.HasValue()) {
+      if (can_fold(lhs_var)) {
+        fold(lhs_var);
+        var_id_to_alu_location[op->result.Unwrap().id] = location;
+      } else if (op->rhs.IsVariable() && can_fold(op->rhs.GetVar())) {
+        fold(op->rhs.GetVar());
+      }
+    } else if (op->GetClass() == IROpcodeClass::SUB || op->GetClass() == IROpcodeClass::AND) {
+      // CMP and TST read their operands only.
+      if (can_fold(lhs_var)) {
+        fold(lhs_var);
+      }
+    }
+  };
+
+  for (auto const& op : emitter.Code()) {
+    switch (op->GetClass()) {
+      case IROpcodeClass::LoadGPR: {
+        auto load = lunatic_cast<IRLoadGPR>(op.get());
+        auto& result_var = load->result.Get();
+
+        var_id_to_load[result_var.id] = load;
+        var_id_to_load_location[result_var.id] = location;
+        last_load_location[get_offset(load->reg)] = location;
+        break;
+      }
+      case IROpcodeClass::StoreGPR: {
+        auto store = lunatic_cast<IRStoreGPR>(op.get());
+        auto offset = get_offset(store->reg);
+
+        /* Fold the store of an ALU result, which read the same guest register from memory,
+         * unless the guest register was loaded again or stored to after the load.
+         */
+        if (store->value.IsVariable()) {
+          auto& value_var = store->value.GetVar();
+          auto alu_location = var_id_to_alu_location[value_var.id];
+
+          if (alu_location != -1 && number_of_reads[value_var.id] == 1) {
+            auto load = (IRLoadGPR*)folded_ops[alu_location];
+            auto load_location = var_id_to_load_location[load->result.Get().id];
+
+            if (get_offset(load->reg) == offset &&
+                get_location(last_load_location, offset) < alu_location &&
+                get_location(last_store_location, offset) < load_location) {
+              folded_stores[value_var.id] = store;
+              folded_ops[location] = store;
+            }
+          }
+        }
+
+        last_store_location[offset] = location;
+        break;
+      }
+      case IROpcodeClass::ADD: fold_into_alu(lunatic_cast<IRAdd>(op.get())); break;
+      case IROpcodeClass::SUB: fold_into_alu(lunatic_cast<IRSub>(op.get())); break;
+      case IROpcodeClass::AND: fold_into_alu(lunatic_cast<IRBitwiseAND>(op.get())); break;
+      case IROpcodeClass::ORR: fold_into_alu(lunatic_cast<IRBitwiseORR>(op.get())); break;
+      case IROpcodeClass::EOR: fold_into_alu(lunatic_cast<IRBitwiseEOR>(op.get())); break;
+      default: break;
+    }
+
+    location++;
+  }
+}
+
+void X64Backend::CompileFoldedGPRAccess(CompileContext const& context, IROpcode* op) {
+  switch (op->GetClass()) {
+    case IROpcodeClass::ADD: CompileFoldedALU(context, lunatic_cast<IRAdd>(op)); break;
+    case IROpcodeClass::SUB: CompileFoldedALU(context, lunatic_cast<IRSub>(op)); break;
+    case IROpcodeClass::AND: CompileFoldedALU(context, lunatic_cast<IRBitwiseAND>(op)); break;
+    case IROpcodeClass::ORR: CompileFoldedALU(context, lunatic_cast<IRBitwiseORR>(op)); break;
+    case IROpcodeClass::EOR: CompileFoldedALU(context, lunatic_cast<IRBitwiseEOR>(op)); break;
+    default: {
+      throw std::runtime_error(
+        fmt::format("lunatic: unhandled IR opcode with folded load: {}", op->ToString())
+      );
+    }
+  }
+}
+
+template<typename T>
+void X64Backend::CompileFoldedALU(CompileContext const& context, T* op) {
+  DESTRUCTURE_CONTEXT;
+
+  constexpr bool commutative = T::klass != IROpcodeClass::SUB;
+
+  auto& lhs_var = op->lhs.Get();
+  auto  lhs_load = folded_loads[lhs_var.id];
+  auto  rhs_load = op->rhs.IsVariable() ? folded_loads[op->rhs.GetVar().id] : nullptr;
+
+  auto get_address = [&](IRLoadGPR* load) {
+    return dword[rcx + State::GetOffsetToGPR(load->reg.mode, load->reg.reg)];
+  };
+
+  auto emit = [&](Xbyak::Operand const& dst, auto const& src) {
+    if constexpr (T::klass == IROpcodeClass::ADD) code.add(dst, src);
+    if constexpr (T::klass == IROpcodeClass::SUB) code.sub(dst, src);
+    if constexpr (T::klass == IROpcodeClass::AND) code.and_(dst, src);
+    if constexpr (T::klass == IROpcodeClass::ORR) code.or_(dst, src);
+    if constexpr (T::klass == IROpcodeClass::EOR) code.xor_(dst, src);
+  };
+
+  auto emit_with_rhs = [&](Xbyak::Operand const& dst) {
+    if (op->rhs.IsConstant()) {
+      emit(dst, op->rhs.GetConst().value);
+    } else {
+      emit(dst, reg_alloc.GetVariableHostReg(op->rhs.GetVar()));
+    }
+  };
+
+  if (op->result.IsNull()) {
+    auto address = get_address(lhs_load);
+
+    if constexpr (T::klass == IROpcodeClass::AND) {
+      if (op->rhs.IsConstant()) {
+        code.test(address, op->rhs.GetConst().value);
+      } else {
+        code.test(address, reg_alloc.GetVariableHostReg(op->rhs.GetVar()));
+      }
+    } else {
+      if (op->rhs.IsConstant()) {
+        code.cmp(address, op->rhs.GetConst().value);
+      } else {
+        code.cmp(address, reg_alloc.GetVariableHostReg(op->rhs.GetVar()));
+      }
+    }
+  } else {
+    auto& result_var = op->result.Unwrap();
+
+    if (folded_stores[result_var.id] != nullptr) {
+      // Read-modify-write of the guest register
+      emit_with_rhs(get_address(lhs_load));
+    } else if (lhs_load != nullptr && commutative && op->rhs.IsVariable()) {
+      auto& rhs_var = op->rhs.GetVar();
+      auto  rhs_reg = reg_alloc.GetVariableHostReg(rhs_var);
+
+      reg_alloc.ReleaseVarAndReuseHostReg(rhs_var, result_var);
+
+      auto result_reg = reg_alloc.GetVariableHostReg(result_var);
+
+      if (result_reg != rhs_reg) {
+        code.mov(result_reg, rhs_reg);
+      }
+      emit(result_reg, get_address(lhs_load));
+    } else if (lhs_load != nullptr) {
+      // Allocate the rhs first, so that the result is not allocated to the same host register.
+      if (op->rhs.IsVariable()) {
+        reg_alloc.GetVariableHostReg(op->rhs.GetVar());
+      }
+
+      auto result_reg = reg_alloc.GetVariableHostReg(result_var);
+
+      code.mov(result_reg, get_address(lhs_load));
+      emit_with_rhs(result_reg);
+    } else {
+      auto lhs_reg = reg_alloc.GetVariableHostReg(lhs_var);
+
+      reg_alloc.ReleaseVarAndReuseHostReg(lhs_var, result_var);
+
+      auto result_reg = reg_alloc.GetVariableHostReg(result_var);
+
+      if (result_reg != lhs_reg) {
+        code.mov(result_reg, lhs_reg);
+      }
+      emit(result_reg, get_address(rhs_load));
+    }
+  }
+
+  if (op->update_host_flags) {
+    if constexpr (T::klass == IROpcodeClass::ADD) {
+      code.lahf();
+      code.seto(al);
+    } else if constexpr (T::klass == IROpcodeClass::SUB) {
+      code.cmc();
+      code.lahf();
+      code.seto(al);
+    } else {
+      // load flags but preserve carry
+      code.bt(ax, 8); // CF = value of bit8
+      code.lahf();
+    }
+  }
+}
+
 void X64Backend::CompileLoadSPSR(CompileContext const& context, IRLoadSPSR* op) {
   DESTRUCTURE_CONTEXT;
 
-  auto address = rcx + state.GetOffsetToSPSR(op->mode);
+  auto address = rcx + State::GetOffsetToSPSR(op->mode);
   auto host_reg = reg_alloc.GetVariableHostReg(op->result.Get());
 
   code.mov(host_reg, dword[address]);
@@ -44,7 +308,7 @@ void X64Backend::CompileLoadSPSR(CompileContext const& context, IRLoadSPSR* op)
 void X64Backend::CompileStoreSPSR(const CompileContext &context, IRStoreSPSR *op) {
   DESTRUCTURE_CONTEXT;
 
-  auto address = rcx + state.GetOffsetToSPSR(op->mode);
+  auto address = rcx + State::GetOffsetToSPSR(op->mode);
 
   if (op->value.IsConstant()) {
     code.mov(dword[address], op->value.GetConst().value);
@@ -58,7 +322,7 @@ void X64Backend::CompileStoreSPSR(const CompileContext &context, IRStoreSPSR *op
 void X64Backend::CompileLoadCPSR(CompileContext const& context, IRLoadCPSR* op) {
   DESTRUCTURE_CONTEXT;
 
-  auto address = rcx + state.GetOffsetToCPSR();
+  auto address = rcx + State::GetOffsetToCPSR();
   auto host_reg = reg_alloc.GetVariableHostReg(op->result.Get());
 
   code.mov(host_reg, dword[address]);
@@ -67,7 +331,7 @@ void X64Backend::CompileLoadCPSR(CompileContext const& context, IRLoadCPSR* op)
 void X64Backend::CompileStoreCPSR(CompileContext const& context, IRStoreCPSR* op) {
   DESTRUCTURE_CONTEXT;
 
-  auto address = rcx + state.GetOffsetToCPSR();
+  auto address = rcx + State::GetOffsetToCPSR();
 
   if (op->value.IsConstant()) {
     code.mov(dword[address], op->value.GetConst().value);
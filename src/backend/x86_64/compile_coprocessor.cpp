@@ -42,14 +42,14 @@ void X64Backend::CompileMRC(CompileContext const& context, IRReadCoprocessorRegi
 
   Coprocessor* coprocessor = coprocessors[op->coprocessor_id];
 
-  code.mov(kRegArg0, u64(coprocessor));
+  // TODO(fleroviux): cache devirtualized coprocessor member function pointers.
+  const auto read_cop_call = Dynarmic::Backend::X64::Devirtualize<&Coprocessor::Read>(coprocessor);
+  EmitLoadCallTarget(code, read_cop_call,
+    offsetof(Context, coprocessor_read) + op->coprocessor_id * sizeof(Context::Call));
+
   code.mov(kRegArg1.cvt32(), op->opcode1);
   code.mov(kRegArg2.cvt32(), op->cn);
   code.mov(kRegArg3.cvt32(), op->cm);
-
-  // TODO(fleroviux): cache devirtualized coprocessor member function pointers.
-  const auto read_cop_call = Dynarmic::Backend::X64::Devirtualize<&Coprocessor::Read>(coprocessor);
-  code.mov(rax, read_cop_call.fn);
   code.call(rax);
 
 #ifdef ABI_MSVC
@@ -108,14 +108,14 @@ void X64Backend::CompileMCR(CompileContext const& context, IRWriteCoprocessorReg
 
   Coprocessor* coprocessor = coprocessors[op->coprocessor_id];
 
-  code.mov(kRegArg0, u64(coprocessor));
+  // TODO(fleroviux): cache devirtualized coprocessor member function pointers.
+  const auto write_cop_call = Dynarmic::Backend::X64::Devirtualize<&Coprocessor::Write>(coprocessor);
+  EmitLoadCallTarget(code, write_cop_call,
+    offsetof(Context, coprocessor_write) + op->coprocessor_id * sizeof(Context::Call));
+
   code.mov(kRegArg1.cvt32(), op->opcode1);
   code.mov(kRegArg2.cvt32(), op->cn);
   code.mov(kRegArg3.cvt32(), op->cm);
-
-  // TODO(fleroviux): cache devirtualized coprocessor member function pointers.
-  const auto write_cop_call = Dynarmic::Backend::X64::Devirtualize<&Coprocessor::Write>(coprocessor);
-  code.mov(rax, write_cop_call.fn);
   code.call(rax);
 
 #ifdef ABI_MSVC
@@ -36,18 +36,31 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
   auto& itcm = memory.itcm;
   auto& dtcm = memory.dtcm;
 
+  /* Position-independent code cannot know at compile time whether TCM or a page table exist,
+   * so it checks for both at runtime. Only the ARM9 has TCM.
+   */
+  auto pic = position_independent_code;
+  auto emit_itcm = pic ? model == CPU::Descriptor::Model::ARM9 : itcm.data != nullptr;
+  auto emit_dtcm = pic ? model == CPU::Descriptor::Model::ARM9 : dtcm.data != nullptr;
+  auto itcm_mask = pic ? ~0U : itcm.mask;
+  auto dtcm_mask = pic ? ~0U : dtcm.mask;
+
   auto itcm_reg = Xbyak::Reg64{};
 
-  if (itcm.data != nullptr || dtcm.data != nullptr) {
+  if (emit_itcm || emit_dtcm) {
     itcm_reg = reg_alloc.GetTemporaryHostReg().cvt64();
   }
 
   // TODO: deduplicate and clean this up in general.
 
-  if (itcm.data != nullptr) {
+  if (emit_itcm) {
     auto label_not_itcm = Xbyak::Label{};
 
-    code.mov(itcm_reg, u64(&itcm));
+    if (pic) {
+      code.mov(itcm_reg, qword[rcx + offsetof(Context, itcm)]);
+    } else {
+      code.mov(itcm_reg, u64(&itcm));
+    }
 
     code.cmp(byte[itcm_reg + offsetof(Memory::TCM, config.enable_read)], 0);
     code.jz(label_not_itcm);
@@ -58,22 +71,28 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
     code.cmp(address_reg, dword[itcm_reg + offsetof(Memory::TCM, config.limit)]);
     code.ja(label_not_itcm);
 
-    code.mov(rcx, u64(itcm.data));
     code.mov(result_reg, address_reg);
     code.sub(result_reg, dword[itcm_reg + offsetof(Memory::TCM, config.base)]);
 
+    if (pic) {
+      code.mov(rcx, qword[itcm_reg + offsetof(Memory::TCM, data)]);
+      code.and_(result_reg, dword[itcm_reg + offsetof(Memory::TCM, mask)]);
+    } else {
+      code.mov(rcx, u64(itcm.data));
+    }
+
     if (flags & Word) {
-      code.and_(result_reg, itcm.mask & ~3);
+      code.and_(result_reg, itcm_mask & ~3);
       code.mov(result_reg, dword[rcx + result_reg.cvt64()]);
     } else if (flags & Half) {
-      code.and_(result_reg, itcm.mask & ~1);
+      code.and_(result_reg, itcm_mask & ~1);
       if (flags & Signed) {
         code.movsx(result_reg, word[rcx + result_reg.cvt64()]);
       } else {
         code.movzx(result_reg, word[rcx + result_reg.cvt64()]);
       }
     } else if (flags & Byte) {
-      code.and_(result_reg, itcm.mask);
+      code.and_(result_reg, itcm_mask);
       if (flags & Signed) {
         code.movsx(result_reg, byte[rcx + result_reg.cvt64()]);
       } else {
@@ -87,10 +106,14 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
 
   auto dtcm_reg = itcm_reg;
 
-  if (dtcm.data != nullptr) {
+  if (emit_dtcm) {
     auto label_not_dtcm = Xbyak::Label{};
 
-    code.mov(dtcm_reg, u64(&dtcm));
+    if (pic) {
+      code.mov(dtcm_reg, qword[rcx + offsetof(Context, dtcm)]);
+    } else {
+      code.mov(dtcm_reg, u64(&dtcm));
+    }
 
     code.cmp(byte[dtcm_reg + offsetof(Memory::TCM, config.enable_read)], 0);
     code.jz(label_not_dtcm);
@@ -101,22 +124,28 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
     code.cmp(address_reg, dword[dtcm_reg + offsetof(Memory::TCM, config.limit)]);
     code.ja(label_not_dtcm);
 
-    code.mov(rcx, u64(dtcm.data));
     code.mov(result_reg, address_reg);
     code.sub(result_reg, dword[dtcm_reg + offsetof(Memory::TCM, config.base)]);
 
+    if (pic) {
+      code.mov(rcx, qword[dtcm_reg + offsetof(Memory::TCM, data)]);
+      code.and_(result_reg, dword[dtcm_reg + offsetof(Memory::TCM, mask)]);
+    } else {
+      code.mov(rcx, u64(dtcm.data));
+    }
+
     if (flags & Word) {
-      code.and_(result_reg, dtcm.mask & ~3);
+      code.and_(result_reg, dtcm_mask & ~3);
       code.mov(result_reg, dword[rcx + result_reg.cvt64()]);
     } else if (flags & Half) {
-      code.and_(result_reg, dtcm.mask & ~1);
+      code.and_(result_reg, dtcm_mask & ~1);
       if (flags & Signed) {
         code.movsx(result_reg, word[rcx + result_reg.cvt64()]);
       } else {
         code.movzx(result_reg, word[rcx + result_reg.cvt64()]);
       }
     } else if (flags & Byte) {
-      code.and_(result_reg, dtcm.mask);
+      code.and_(result_reg, dtcm_mask);
       if (flags & Signed) {
         code.movsx(result_reg, byte[rcx + result_reg.cvt64()]);
       } else {
@@ -128,8 +157,14 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
     code.L(label_not_dtcm);
   }
 
-  if (pagetable != nullptr) {
-    code.mov(rcx, u64(pagetable));
+  if (pic || pagetable != nullptr) {
+    if (pic) {
+      code.mov(rcx, qword[rcx + offsetof(Context, pagetable)]);
+      code.test(rcx, rcx);
+      code.jz(label_slowmem);
+    } else {
+      code.mov(rcx, u64(pagetable));
+    }
 
     // Get the page table entry
     code.mov(result_reg, address_reg);
@@ -166,6 +201,11 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
 
   code.L(label_slowmem);
 
+  if (pic) {
+    // Restore the context pointer, which was clobbered by the page table lookup.
+    code.mov(rcx, qword[rsp]);
+  }
+
   auto stack_offset = 0x20U;
 
   code.push(rax);
@@ -192,15 +232,12 @@ void X64Backend::CompileMemoryRead(CompileContext const& context, IRMemoryRead*
 
   if (flags & Word) {
     code.and_(kRegArg1.cvt32(), ~3);
-    code.mov(rax, read_word_call.fn);
-    code.mov(kRegArg0, read_word_call.arg);
+    EmitLoadCallTarget(code, read_word_call, offsetof(Context, read_word));
   } else if (flags & Half) {
     code.and_(kRegArg1.cvt32(), ~1);
-    code.mov(rax, read_half_call.fn);
-    code.mov(kRegArg0, read_half_call.arg);
+    EmitLoadCallTarget(code, read_half_call, offsetof(Context, read_half));
   } else if (flags & Byte) {
-    code.mov(rax, read_byte_call.fn);
-    code.mov(kRegArg0, read_byte_call.arg);
+    EmitLoadCallTarget(code, read_byte_call, offsetof(Context, read_byte));
   }
 
   code.mov(kRegArg2.cvt32(), u32(Memory::Bus::Data));
@@ -297,18 +334,31 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
   auto& itcm = memory.itcm;
   auto& dtcm = memory.dtcm;
 
+  /* Position-independent code cannot know at compile time whether TCM or a page table exist,
+   * so it checks for both at runtime. Only the ARM9 has TCM.
+   */
+  auto pic = position_independent_code;
+  auto emit_itcm = pic ? model == CPU::Descriptor::Model::ARM9 : itcm.data != nullptr;
+  auto emit_dtcm = pic ? model == CPU::Descriptor::Model::ARM9 : dtcm.data != nullptr;
+  auto itcm_mask = pic ? ~0U : itcm.mask;
+  auto dtcm_mask = pic ? ~0U : dtcm.mask;
+
   auto itcm_reg = Xbyak::Reg64{};
 
-  if (itcm.data != nullptr || dtcm.data != nullptr) {
+  if (emit_itcm || emit_dtcm) {
     itcm_reg = reg_alloc.GetTemporaryHostReg().cvt64();
   }
 
   // TODO: deduplicate and clean this up in general.
 
-  if (itcm.data != nullptr) {
+  if (emit_itcm) {
     auto label_not_itcm = Xbyak::Label{};
 
-    code.mov(itcm_reg, u64(&itcm));
+    if (pic) {
+      code.mov(itcm_reg, qword[rcx + offsetof(Context, itcm)]);
+    } else {
+      code.mov(itcm_reg, u64(&itcm));
+    }
 
     code.cmp(byte[itcm_reg + offsetof(Memory::TCM, config.enable)], 0);
     code.jz(label_not_itcm);
@@ -319,18 +369,24 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
     code.cmp(address_reg, dword[itcm_reg + offsetof(Memory::TCM, config.limit)]);
     code.ja(label_not_itcm);
 
-    code.mov(rcx, u64(itcm.data));
     code.mov(scratch_reg, address_reg);
     code.sub(scratch_reg, dword[itcm_reg + offsetof(Memory::TCM, config.base)]);
 
+    if (pic) {
+      code.mov(rcx, qword[itcm_reg + offsetof(Memory::TCM, data)]);
+      code.and_(scratch_reg, dword[itcm_reg + offsetof(Memory::TCM, mask)]);
+    } else {
+      code.mov(rcx, u64(itcm.data));
+    }
+
     if (flags & Word) {
-      code.and_(scratch_reg, itcm.mask & ~3);
+      code.and_(scratch_reg, itcm_mask & ~3);
       code.mov(dword[rcx + scratch_reg.cvt64()], source_reg);
     } else if (flags & Half) {
-      code.and_(scratch_reg, itcm.mask & ~1);
+      code.and_(scratch_reg, itcm_mask & ~1);
       code.mov(word[rcx + scratch_reg.cvt64()], source_reg.cvt16());
     } else if (flags & Byte) {
-      code.and_(scratch_reg, itcm.mask);
+      code.and_(scratch_reg, itcm_mask);
       code.mov(byte[rcx + scratch_reg.cvt64()], source_reg.cvt8());
     }
 
@@ -340,10 +396,14 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
 
   auto dtcm_reg = itcm_reg;
 
-  if (dtcm.data != nullptr) {
+  if (emit_dtcm) {
     auto label_not_dtcm = Xbyak::Label{};
 
-    code.mov(dtcm_reg, u64(&dtcm));
+    if (pic) {
+      code.mov(dtcm_reg, qword[rcx + offsetof(Context, dtcm)]);
+    } else {
+      code.mov(dtcm_reg, u64(&dtcm));
+    }
 
     code.cmp(byte[dtcm_reg + offsetof(Memory::TCM, config.enable)], 0);
     code.jz(label_not_dtcm);
@@ -354,18 +414,24 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
     code.cmp(address_reg, dword[dtcm_reg + offsetof(Memory::TCM, config.limit)]);
     code.ja(label_not_dtcm);
 
-    code.mov(rcx, u64(dtcm.data));
     code.mov(scratch_reg, address_reg);
     code.sub(scratch_reg, dword[dtcm_reg + offsetof(Memory::TCM, config.base)]);
 
+    if (pic) {
+      code.mov(rcx, qword[dtcm_reg + offsetof(Memory::TCM, data)]);
+      code.and_(scratch_reg, dword[dtcm_reg + offsetof(Memory::TCM, mask)]);
+    } else {
+      code.mov(rcx, u64(dtcm.data));
+    }
+
     if (flags & Word) {
-      code.and_(scratch_reg, dtcm.mask & ~3);
+      code.and_(scratch_reg, dtcm_mask & ~3);
       code.mov(dword[rcx + scratch_reg.cvt64()], source_reg);
     } else if (flags & Half) {
-      code.and_(scratch_reg, dtcm.mask & ~1);
+      code.and_(scratch_reg, dtcm_mask & ~1);
       code.mov(word[rcx + scratch_reg.cvt64()], source_reg.cvt16());
     } else if (flags & Byte) {
-      code.and_(scratch_reg, dtcm.mask);
+      code.and_(scratch_reg, dtcm_mask);
       code.mov(byte[rcx + scratch_reg.cvt64()], source_reg.cvt8());
     }
 
@@ -373,8 +439,14 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
     code.L(label_not_dtcm);
   }
 
-  if (pagetable != nullptr) {
-    code.mov(rcx, u64(pagetable));
+  if (pic || pagetable != nullptr) {
+    if (pic) {
+      code.mov(rcx, qword[rcx + offsetof(Context, pagetable)]);
+      code.test(rcx, rcx);
+      code.jz(label_slowmem);
+    } else {
+      code.mov(rcx, u64(pagetable));
+    }
 
     // Get the page table entry
     code.mov(scratch_reg, address_reg);
@@ -403,6 +475,11 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
 
   code.L(label_slowmem);
 
+  if (pic) {
+    // Restore the context pointer, which was clobbered by the page table lookup.
+    code.mov(rcx, qword[rsp]);
+  }
+
   auto stack_offset = 0x20U;
 
   // Get caller-saved registers that need to be saved.
@@ -442,15 +519,12 @@ void X64Backend::CompileMemoryWrite(CompileContext const& context, IRMemoryWrite
 
   if (flags & Word) {
     code.and_(kRegArg1.cvt32(), ~3);
-    code.mov(rax, write_word_call.fn);
-    code.mov(kRegArg0, write_word_call.arg);
+    EmitLoadCallTarget(code, write_word_call, offsetof(Context, write_word));
   } else if (flags & Half) {
     code.and_(kRegArg1.cvt32(), ~1);
-    code.mov(rax, write_half_call.fn);
-    code.mov(kRegArg0, write_half_call.arg);
+    EmitLoadCallTarget(code, write_half_call, offsetof(Context, write_half));
   } else if (flags & Byte) {
-    code.mov(rax, write_byte_call.fn);
-    code.mov(kRegArg0, write_byte_call.arg);
+    EmitLoadCallTarget(code, write_byte_call, offsetof(Context, write_byte));
   }
 
   code.mov(kRegArg3.cvt32(), u32(Memory::Bus::Data));
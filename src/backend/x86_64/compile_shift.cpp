@@ -21,6 +21,23 @@ void X64Backend::CompileLSL(CompileContext const& context, IRLogicalShiftLeft* o
 
   auto result_reg = reg_alloc.GetVariableHostReg(result_var);
 
+  // Without the carry flag a plain 32-bit shift is sufficient.
+  if (amount.IsConstant() && !op->update_host_flags) {
+    auto amount_value = amount.GetConst().value;
+
+    if (amount_value >= 32) {
+      code.xor_(result_reg, result_reg);
+    } else {
+      if (result_reg != operand_reg) {
+        code.mov(result_reg, operand_reg);
+      }
+      if (amount_value != 0) {
+        code.shl(result_reg, u8(amount_value));
+      }
+    }
+    return;
+  }
+
   if (result_reg != operand_reg) {
     code.mov(result_reg, operand_reg);
   }
@@ -65,6 +82,22 @@ void X64Backend::CompileLSR(CompileContext const& context, IRLogicalShiftRight*
   reg_alloc.ReleaseVarAndReuseHostReg(operand_var, result_var);
 
   auto result_reg = reg_alloc.GetVariableHostReg(result_var);
+
+  // Without the carry flag a plain 32-bit shift is sufficient.
+  if (amount.IsConstant() && !op->update_host_flags) {
+    auto amount_value = amount.GetConst().value;
+
+    // LSR #0 equals to LSR #32
+    if (amount_value == 0 || amount_value >= 32) {
+      code.xor_(result_reg, result_reg);
+    } else {
+      if (result_reg != operand_reg) {
+        code.mov(result_reg, operand_reg);
+      }
+      code.shr(result_reg, u8(amount_value));
+    }
+    return;
+  }
   
   if (result_reg != operand_reg) {
     code.mov(result_reg, operand_reg);
@@ -113,6 +146,22 @@ void X64Backend::CompileASR(CompileContext const& context, IRArithmeticShiftRigh
 
   auto result_reg = reg_alloc.GetVariableHostReg(result_var);
 
+  // Without the carry flag a plain 32-bit shift is sufficient.
+  if (amount.IsConstant() && !op->update_host_flags) {
+    auto amount_value = amount.GetConst().value;
+
+    // ASR #0 equals to ASR #32, which like any larger amount fills the result with the sign-bit.
+    if (amount_value == 0 || amount_value > 31) {
+      amount_value = 31;
+    }
+
+    if (result_reg != operand_reg) {
+      code.mov(result_reg, operand_reg);
+    }
+    code.sar(result_reg, u8(amount_value));
+    return;
+  }
+
   // Mirror sign-bit in the upper 32-bit of the full 64-bit register.
   code.movsxd(result_reg.cvt64(), operand_reg);
 
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <frontend/basic_block.hpp>
+
+#include "symbol_name.hpp"
+
+#if LUNATIC_USE_PERF
+
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Reports compiled code to Linux perf, in two formats:
+ * - /tmp/perf-<pid>.map, which perf reads when resolving samples in anonymous memory.
+ * - /tmp/jit-<pid>.dump, the jitdump format, which `perf inject --jit` merges into a recording.
+ *   Timestamps use CLOCK_MONOTONIC, so the recording must be made with `perf record -k 1`.
+ *
+ * Neither format can remove symbols. Evicted code stays in the code buffer until it is flushed,
+ * after which jitdump resolves reused addresses by the load timestamps. The perf map does not,
+ * so profiles across a code buffer flush should be made with jitdump.
+ */
+namespace perf {
+
+namespace detail {
+
+// See tools/perf/Documentation/jitdump-specification.txt in the Linux sources.
+struct JitDumpHeader {
+  u32 magic;
+  u32 version;
+  u32 total_size;
+  u32 elf_mach;
+  u32 pad1;
+  u32 pid;
+  u64 timestamp;
+  u64 flags;
+};
+
+struct JitDumpRecordHeader {
+  u32 id;
+  u32 total_size;
+  u64 timestamp;
+};
+
+struct JitDumpCodeLoad {
+  JitDumpRecordHeader header;
+  u32 pid;
+  u32 tid;
+  u64 vma;
+  u64 code_addr;
+  u64 code_size;
+  u64 code_index;
+};
+
+static constexpr u32 kJitDumpMagic = 0x4A695444;
+static constexpr u32 kJitDumpVersion = 1;
+static constexpr u32 kElfMachineX86_64 = 62;
+static constexpr u32 kJitCodeLoad = 0;
+static constexpr u32 kJitCodeClose = 3;
+
+inline auto GetTimestamp() -> u64 {
+  timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return u64(time.tv_sec) * 1000000000 + u64(time.tv_nsec);
+}
+
+struct Session {
+  Session() : pid(getpid()) {
+    perf_map = std::fopen(fmt::format("/tmp/perf-{}.map", pid).c_str(), "w");
+
+    int fd = open(fmt::format("/tmp/jit-{}.dump", pid).c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+
+    if (fd != -1) {
+      // perf record only notices the jitdump file through an executable mapping of it.
+      marker = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+      jitdump = fdopen(fd, "wb");
+
+      auto header = JitDumpHeader{};
+
+      header.magic = kJitDumpMagic;
+      header.version = kJitDumpVersion;
+      header.total_size = sizeof(JitDumpHeader);
+      header.elf_mach = kElfMachineX86_64;
+      header.pid = u32(pid);
+      header.timestamp = GetTimestamp();
+      std::fwrite(&header, sizeof(header), 1, jitdump);
+    }
+  }
+
+ ~Session() {
+    if (perf_map) {
+      std::fclose(perf_map);
+    }
+
+    if (jitdump) {
+      auto record = JitDumpRecordHeader{kJitCodeClose, sizeof(JitDumpRecordHeader), GetTimestamp()};
+
+      std::fwrite(&record, sizeof(record), 1, jitdump);
+      std::fclose(jitdump);
+    }
+
+    if (marker != MAP_FAILED) {
+      munmap(marker, sysconf(_SC_PAGESIZE));
+    }
+  }
+
+  void ReportCode(std::string const& name, u8 const* code_begin, u8 const* code_end) {
+    auto size = u64(code_end - code_begin);
+    auto lock = std::lock_guard{mutex};
+
+    if (perf_map) {
+      std::fprintf(perf_map, "%llx %llx %s\n", (unsigned long long)code_begin, (unsigned long long)size, name.c_str());
+      std::fflush(perf_map);
+    }
+
+    if (jitdump) {
+      auto record = JitDumpCodeLoad{};
+
+      record.header.id = kJitCodeLoad;
+      record.header.total_size = u32(sizeof(JitDumpCodeLoad) + name.size() + 1 + size);
+      record.header.timestamp = GetTimestamp();
+      record.pid = u32(pid);
+      record.tid = u32(syscall(SYS_gettid));
+      record.vma = u64(code_begin);
+      record.code_addr = u64(code_begin);
+      record.code_size = size;
+      record.code_index = code_index++;
+
+      std::fwrite(&record, sizeof(record), 1, jitdump);
+      std::fwrite(name.c_str(), name.size() + 1, 1, jitdump);
+      std::fwrite(code_begin, size, 1, jitdump);
+      std::fflush(jitdump);
+    }
+  }
+
+  pid_t pid;
+  std::FILE* perf_map = nullptr;
+  std::FILE* jitdump = nullptr;
+  void* marker = MAP_FAILED;
+  u64 code_index = 0;
+  std::mutex mutex;
+};
+
+inline auto GetSession() -> Session& {
+  static Session session;
+  return session;
+}
+
+} // namespace perf::detail
+
+static void ReportCallBlock(u8* codeBegin, const u8* codeEnd) {
+  detail::GetSession().ReportCode("lunatic_x64_callblock", codeBegin, codeEnd);
+}
+
+static void ReportBasicBlock(lunatic::frontend::BasicBlock& basic_block, const u8* codeEnd) {
+  auto name = lunatic::backend::GetSymbolName(basic_block.key);
+
+  detail::GetSession().ReportCode(name, reinterpret_cast<u8*>(basic_block.function), codeEnd);
+}
+
+} // namespace perf
+
+#endif
@@ -49,14 +49,14 @@ X64RegisterAllocator::X64RegisterAllocator(
 }
 
 void X64RegisterAllocator::AdvanceLocation() {
-  location++;
-  current_op_iter++;
-
   // Release host regs that hold variables which now are dead.
   ReleaseDeadVariables();
 
   // Release host regs the previous opcode allocated temporarily.
   ReleaseTemporaryHostRegs();
+
+  location++;
+  current_op_iter++;
 }
 
 auto X64RegisterAllocator::GetVariableHostReg(IRVariable const& var) -> Xbyak::Reg32 {
@@ -107,6 +107,18 @@ void X64RegisterAllocator::ReleaseVarAndReuseHostReg(
   }
 }
 
+void X64RegisterAllocator::ExtendLifetime(
+  IRVariable const& var,
+  int location
+) {
+  auto& point_of_last_use = var_id_to_point_of_last_use[var.id];
+
+  if (point_of_last_use < location) {
+    point_of_last_use = location;
+    extended_vars.push_back(&var);
+  }
+}
+
 bool X64RegisterAllocator::IsHostRegFree(Xbyak::Reg64 reg) const {
   auto begin = free_host_regs.begin();
   auto end = free_host_regs.end();
@@ -115,35 +127,45 @@ bool X64RegisterAllocator::IsHostRegFree(Xbyak::Reg64 reg) const {
 }
 
 void X64RegisterAllocator::EvaluateVariableLifetimes() {
-  for (auto const& var : emitter.Vars()) {
-    int point_of_last_use = -1;
-    int location = 0;
+  int location = 0;
 
-    for (auto const& op : emitter.Code()) {
-      if (op->Writes(*var) || op->Reads(*var)) {
-        point_of_last_use = location;
-      }
-
-      location++;
+  for (auto const& op : emitter.Code()) {
+    for (auto var : op->GetReads()) {
+      var_id_to_point_of_last_use[var->id] = location;
     }
 
-    if (point_of_last_use != -1) {
-      var_id_to_point_of_last_use[var->id] = point_of_last_use;
+    for (auto var : op->GetWrites()) {
+      var_id_to_point_of_last_use[var->id] = location;
     }
+
+    location++;
   }
 }
 
 void X64RegisterAllocator::ReleaseDeadVariables() {
-  for (auto const& var : emitter.Vars()) {
-    auto point_of_last_use = var_id_to_point_of_last_use[var->id];
-
-    if (location > point_of_last_use) {
+  auto release = [&](IRVariable const* var) {
+    if (var_id_to_point_of_last_use[var->id] == location) {
       auto maybe_reg = var_id_to_host_reg[var->id];
       if (maybe_reg.HasValue()) {
         free_host_regs.push_back(maybe_reg.Unwrap());
         var_id_to_host_reg[var->id] = {};
       }
     }
+  };
+
+  // Variables die at the last opcode which accesses them, which might be the current opcode.
+  auto const& op = *current_op_iter;
+
+  for (auto var : op->GetReads()) {
+    release(var);
+  }
+
+  for (auto var : op->GetWrites()) {
+    release(var);
+  }
+
+  for (auto var : extended_vars) {
+    release(var);
   }
 }
 
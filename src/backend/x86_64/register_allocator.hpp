@@ -68,13 +68,25 @@ struct X64RegisterAllocator {
     lunatic::frontend::IRVariable const& var_new
   );
 
+  /**
+   * Keep a variable alive until a later opcode, which reads it
+   * on behalf of an opcode that was folded into it.
+   * 
+   * @param  var       the variable
+   * @param  location  the location of the opcode reading the variable
+   */
+  void ExtendLifetime(
+    lunatic::frontend::IRVariable const& var,
+    int location
+  );
+
   bool IsHostRegFree(Xbyak::Reg64 reg) const;
 
 private:
   /// Determine when each variable will be dead.
   void EvaluateVariableLifetimes();
 
-  /// Release host registers allocated to variables that are dead.
+  /// Release host registers allocated to variables that are dead after the current opcode.
   void ReleaseDeadVariables();
 
   /// Release host registers allocated for temporary storage.
@@ -101,6 +113,9 @@ private:
   /// Map variable to the last location where it's accessed.
   std::vector<int> var_id_to_point_of_last_use;
 
+  /// Variables that are alive past the last opcode accessing them.
+  std::vector<lunatic::frontend::IRVariable const*> extended_vars;
+
   /// The set of free/unused spill slots.
   std::bitset<kSpillAreaSize> free_spill_bitmap;
 
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <fmt/format.h>
+#include <frontend/basic_block.hpp>
+#include <string>
+
+namespace lunatic {
+namespace backend {
+
+/// \returns the name under which a compiled basic block is reported to profilers.
+inline auto GetSymbolName(frontend::BasicBlock::Key key) -> std::string {
+  auto modeStr = [&]() -> std::string {
+    switch (key.Mode()) {
+      case Mode::User: return "USR";
+      case Mode::FIQ: return "FIQ";
+      case Mode::IRQ: return "IRQ";
+      case Mode::Supervisor: return "SVC";
+      case Mode::Abort: return "ABT";
+      case Mode::Undefined: return "UND";
+      case Mode::System: return "SYS";
+      default: return fmt::format("{:02X}", static_cast<uint>(key.Mode()));
+    }
+  }();
+
+  auto thumbStr = key.Thumb() ? "Thumb" : "ARM";
+
+  return fmt::format("lunatic_func_{:X}_{}_{}", key.Address(), modeStr, thumbStr);
+}
+
+} // namespace lunatic::backend
+} // namespace lunatic
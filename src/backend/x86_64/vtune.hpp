@@ -7,9 +7,10 @@
 
 #pragma once
 
-#include <fmt/format.h>
 #include <frontend/basic_block.hpp>
 
+#include "symbol_name.hpp"
+
 #if LUNATIC_USE_VTUNE
 
 #include <jitprofiling.h>
@@ -33,25 +34,7 @@ static void ReportCallBlock(u8* codeBegin, const u8* codeEnd) {
 
 static void ReportBasicBlock(lunatic::frontend::BasicBlock& basic_block, const u8* codeEnd) {
   if (iJIT_IsProfilingActive() == iJIT_SAMPLING_ON) {
-    auto& key = basic_block.key;
-
-    auto modeStr = [&]() -> std::string {
-      using lunatic::Mode;
-
-      switch (key.Mode()) {
-        case Mode::User: return "USR";
-        case Mode::FIQ: return "FIQ";
-        case Mode::IRQ: return "IRQ";
-        case Mode::Supervisor: return "SVC";
-        case Mode::Abort: return "ABT";
-        case Mode::Undefined: return "UND";
-        case Mode::System: return "SYS";
-        default: return fmt::format("{:02X}", static_cast<uint>(key.Mode()));
-      }
-    }();
-
-    auto thumbStr = key.Thumb() ? "Thumb" : "ARM";
-    auto methodName = fmt::format("lunatic_func_{:X}_{}_{}", key.Address(), modeStr, thumbStr);
+    auto methodName = lunatic::backend::GetSymbolName(basic_block.key);
     char moduleName[] = "lunatic-JIT";
 
     iJIT_Method_Load_V2 jmethod = { 0 };
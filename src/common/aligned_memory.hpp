@@ -8,6 +8,7 @@
 #pragma once
 
 #include <cstdlib>
+#include <memory>
 
 #ifdef __APPLE__
 #include <libkern/OSCacheControl.h>
@@ -157,8 +158,61 @@ namespace memory {
     }
   };
 
+#ifdef __linux__
+  /**
+   * Maps the same memory twice, once as read-write and once as read-execute.
+   * Code can then be written without changing page protections, while no page
+   * is writable and executable at the same time.
+   */
+  class DualMappedMemoryBlock {
+  public:
+    void* ptr = nullptr;
+    void* executable_ptr = nullptr;
+    std::size_t size;
+    std::size_t real_size;
+
+    explicit DualMappedMemoryBlock(std::size_t size) : size(size), real_size((size + s_PageSize) & ~(s_PageSize - 1)) {
+      int fd = memfd_create("lunatic-code", MFD_CLOEXEC);
+
+      if (fd == -1) {
+        return;
+      }
+
+      if (ftruncate(fd, this->real_size) == 0) {
+        void* p0 = mmap(nullptr, this->real_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        void* p1 = mmap(nullptr, this->real_size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+
+        if (p0 != MAP_FAILED && p1 != MAP_FAILED) {
+          this->ptr = p0;
+          this->executable_ptr = p1;
+        } else {
+          if (p0 != MAP_FAILED) munmap(p0, this->real_size);
+          if (p1 != MAP_FAILED) munmap(p1, this->real_size);
+        }
+      }
+
+      // The mappings keep the memory alive.
+      close(fd);
+    }
+
+    ~DualMappedMemoryBlock() {
+      if (IsValid()) {
+        munmap(this->ptr, this->real_size);
+        munmap(this->executable_ptr, this->real_size);
+      }
+    }
+
+    bool IsValid() const {
+      return this->ptr != nullptr;
+    }
+  };
+#endif
+
   class CodeBlockMemory {
-    MemoryBlock memory_block;
+#ifdef __linux__
+    std::unique_ptr<DualMappedMemoryBlock> dual_mapped_block;
+#endif
+    std::unique_ptr<MemoryBlock> memory_block;
 
     #if (defined (__APPLE__) && defined(__aarch64__)) || defined(_WIN32)
     static const MemoryProtection InitialMemoryProtection = static_cast<MemoryProtection>(MemoryProtection_Read | MemoryProtection_Write | MemoryProtection_Execute);
@@ -167,46 +221,103 @@ namespace memory {
     #endif
 
   public:
-    CodeBlockMemory(std::size_t size) : memory_block(size, InitialMemoryProtection) {
+    CodeBlockMemory(std::size_t size) {
+      #ifdef __linux__
+      dual_mapped_block = std::make_unique<DualMappedMemoryBlock>(size);
+      if (dual_mapped_block->IsValid()) {
+        return;
+      }
+      // memfd_create() may be unavailable, for example inside of a sandbox.
+      dual_mapped_block.reset();
+      #endif
+
+      memory_block = std::make_unique<MemoryBlock>(size, InitialMemoryProtection);
+
       #if defined(__APPLE__) && defined(__aarch64__)
       ProtectForWrite();
       #endif
     }
 
+    bool IsDualMapped() const {
+      #ifdef __linux__
+      return dual_mapped_block != nullptr;
+      #else
+      return false;
+      #endif
+    }
+
     bool ProtectForWrite() {
+      if (IsDualMapped()) {
+        return true;
+      }
+
       #if defined(_WIN32)
       return true;
       #elif defined(__APPLE__) && defined(__aarch64__)
       pthread_jit_write_protect_np(0);
       return true;
       #else
-      return memory_block.Protect(static_cast<MemoryProtection>(MemoryProtection_Read | MemoryProtection_Write));
+      return memory_block->Protect(static_cast<MemoryProtection>(MemoryProtection_Read | MemoryProtection_Write));
       #endif
     }
 
     bool ProtectForExecute() {
+      if (IsDualMapped()) {
+        return true;
+      }
+
       #if defined(_WIN32)
       return true;
       #elif defined(__APPLE__) && defined(__aarch64__)
       pthread_jit_write_protect_np(1);
       return true;
       #else
-      return memory_block.Protect(static_cast<MemoryProtection>(MemoryProtection_Read | MemoryProtection_Execute));
+      return memory_block->Protect(static_cast<MemoryProtection>(MemoryProtection_Read | MemoryProtection_Execute));
       #endif
     }
 
     void Invalidate() {
       #if defined (__APPLE__)
-        sys_icache_invalidate(memory_block.ptr, memory_block.real_size);
+        sys_icache_invalidate(memory_block->ptr, memory_block->real_size);
+      #elif defined(_WIN32)
+        FlushInstructionCache(GetCurrentProcess(), memory_block->ptr, memory_block->real_size);
+      #elif defined(__linux__) && defined(__aarch64__)
+        #error "Implement cache invalidation logic for linux aarch64"
+      #endif
+    }
+
+    // Invalidate the instruction cache only for a range of executable code, for example after patching a jump.
+    void Invalidate(void const* address, std::size_t size) {
+      #if defined (__APPLE__)
+        sys_icache_invalidate(const_cast<void*>(address), size);
       #elif defined(_WIN32)
-        FlushInstructionCache(GetCurrentProcess(), memory_block.ptr, memory_block.real_size);
+        FlushInstructionCache(GetCurrentProcess(), address, size);
       #elif defined(__linux__) && defined(__aarch64__)
         #error "Implement cache invalidation logic for linux aarch64"
+      #else
+        (void)address;
+        (void)size;
       #endif
     }
 
+    // Pointer to write code to.
     void *GetPointer() {
-      return memory_block.ptr;
+      #ifdef __linux__
+      if (IsDualMapped()) {
+        return dual_mapped_block->ptr;
+      }
+      #endif
+      return memory_block->ptr;
+    }
+
+    // Pointer to execute code from. This may differ from GetPointer().
+    void *GetExecutablePointer() {
+      #ifdef __linux__
+      if (IsDualMapped()) {
+        return dual_mapped_block->executable_ptr;
+      }
+      #endif
+      return memory_block->ptr;
     }
   };
 
@@ -0,0 +1,14 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "arena_allocator.hpp"
+
+namespace lunatic {
+
+thread_local ArenaAllocator g_ir_arena;
+
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <lunatic/integer.hpp>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace lunatic {
+
+/**
+ * Bump allocator for short-lived objects, which are allocated and released in bulk.
+ * Objects are laid out contiguously in the order of their allocation. Releasing an object
+ * does not reclaim its memory, instead the arena is reset in O(1) once all objects have been released.
+ * After a reset at most kMaxRetainedSize bytes are kept for reuse.
+ */
+struct ArenaAllocator {
+  auto Allocate(size_t size) -> void* {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+
+    if (size > size_t(end - next)) {
+      NextChunk(size);
+    }
+
+    auto object = next;
+
+    next += size;
+    live_objects++;
+    return object;
+  }
+
+  void Release(void* object) {
+    if (--live_objects == 0) {
+      Reset();
+    }
+  }
+
+  /**
+   * Reset the arena explicitly, once a unit of work (e.g. compiling a basic block) is done.
+   * Objects which are still alive would keep the arena from being reset and let it grow without bound,
+   * so this throws std::logic_error if any object has not been released.
+   */
+  void Reset() {
+    if (live_objects != 0) {
+      throw std::logic_error("ArenaAllocator: requirement not met: all objects must have been released.");
+    }
+
+    if (!chunks.empty()) {
+      // Free the chunks above the high-water mark, which were only needed for unusually large units of work.
+      size_t retained_size = 0;
+      size_t retained_chunks = 0;
+
+      while (retained_chunks < chunks.size() && retained_size + chunks[retained_chunks].size <= kMaxRetainedSize) {
+        retained_size += chunks[retained_chunks++].size;
+      }
+
+      chunks.resize(std::max<size_t>(retained_chunks, 1));
+
+      chunk_index = 0;
+      next = chunks[0].data.get();
+      end = next + chunks[0].size;
+    }
+  }
+
+private:
+  static constexpr size_t kChunkSize = 256 * 1024;
+  static constexpr size_t kMaxRetainedSize = 4 * kChunkSize;
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+  struct Chunk {
+    std::unique_ptr<u8[]> data;
+    size_t size;
+  };
+
+  void NextChunk(size_t size) {
+    // Reuse the chunks which have been allocated before the last reset.
+    while (!chunks.empty() && ++chunk_index < chunks.size()) {
+      if (chunks[chunk_index].size >= size) {
+        next = chunks[chunk_index].data.get();
+        end = next + chunks[chunk_index].size;
+        return;
+      }
+    }
+
+    auto chunk_size = std::max(size, kChunkSize);
+
+    chunks.push_back({std::make_unique<u8[]>(chunk_size), chunk_size});
+    chunk_index = chunks.size() - 1;
+    next = chunks[chunk_index].data.get();
+    end = next + chunk_size;
+  }
+
+  std::vector<Chunk> chunks;
+  size_t chunk_index = 0;
+  u8* next = nullptr;
+  u8* end = nullptr;
+  size_t live_objects = 0;
+};
+
+/// Holds the IR of the basic block, which is currently being compiled on this thread.
+extern thread_local ArenaAllocator g_ir_arena;
+
+struct ArenaObject {
+  auto operator new(size_t size) -> void* {
+    return g_ir_arena.Allocate(size);
+  }
+
+  void operator delete(void* object) {
+    g_ir_arena.Release(object);
+  }
+};
+
+// Wrapper around g_ir_arena that implements the 'Allocator' named requirements:
+// https://en.cppreference.com/w/cpp/named_req/Allocator
+template<typename T>
+struct StdArenaAlloc {
+  using value_type = T;
+
+  StdArenaAlloc() = default;
+
+  template <typename T2>
+  StdArenaAlloc(const StdArenaAlloc<T2>&) {}
+
+  bool operator==(const StdArenaAlloc<T>&) const noexcept {
+    return true;
+  }
+
+  bool operator!=(const StdArenaAlloc<T>&) const noexcept {
+    return false;
+  }
+
+  auto allocate(std::size_t n) -> T* {
+    return (T*)g_ir_arena.Allocate(n * sizeof(T));
+  }
+
+  void deallocate(T* p, size_t n) {
+    g_ir_arena.Release(p);
+  }
+};
+
+} // namespace lunatic
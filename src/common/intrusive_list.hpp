@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+namespace lunatic {
+
+/**
+ * Node of a circular doubly-linked list, which lets an object be moved between lists in constant time.
+ * A list is represented by a head node, which is not embedded into an object.
+ * A node which is not part of any list (and the head node of an empty list) links to itself.
+ */
+struct IntrusiveListNode {
+  IntrusiveListNode() = default;
+  IntrusiveListNode(IntrusiveListNode const&) = delete;
+
+ ~IntrusiveListNode() {
+    Unlink();
+  }
+
+  auto operator=(IntrusiveListNode const&) -> IntrusiveListNode& = delete;
+
+  bool IsEmpty() const {
+    return next == this;
+  }
+
+  void Unlink() {
+    prev->next = next;
+    next->prev = prev;
+    prev = this;
+    next = this;
+  }
+
+  // Remove the node from its current list and append it to the list represented by the head node.
+  void MoveTo(IntrusiveListNode& head) {
+    Unlink();
+    prev = head.prev;
+    next = &head;
+    head.prev->next = this;
+    head.prev = this;
+  }
+
+  IntrusiveListNode* prev = this;
+  IntrusiveListNode* next = this;
+};
+
+} // namespace lunatic
@@ -5,10 +5,45 @@
  * found in the LICENSE file.
  */
 
+#include <new>
+
 #include "pool_allocator.hpp"
 
 namespace lunatic {
 
-PoolAllocator<u16, 4096, 134> g_pool_alloc;
+using PoolAllocator64  = PoolAllocator<u16, 4096,  64>;
+using PoolAllocator128 = PoolAllocator<u16, 4096, 128>;
+using PoolAllocator256 = PoolAllocator<u16, 2048, 256>;
+using PoolAllocator512 = PoolAllocator<u16, 1024, 512>;
+
+auto PoolAllocate(size_t size) -> void* {
+  if (size <= 64) {
+    return PoolAllocator64::Get().Allocate();
+  }
+  if (size <= 128) {
+    return PoolAllocator128::Get().Allocate();
+  }
+  if (size <= 256) {
+    return PoolAllocator256::Get().Allocate();
+  }
+  if (size <= 512) {
+    return PoolAllocator512::Get().Allocate();
+  }
+  return ::operator new(size);
+}
 
+void PoolRelease(void* object, size_t size) {
+  if (size <= 64) {
+    PoolAllocator64::Release(object);
+  } else if (size <= 128) {
+    PoolAllocator128::Release(object);
+  } else if (size <= 256) {
+    PoolAllocator256::Release(object);
+  } else if (size <= 512) {
+    PoolAllocator512::Release(object);
+  } else {
+    ::operator delete(object);
+  }
 }
+
+} // namespace lunatic
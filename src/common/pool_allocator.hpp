@@ -7,8 +7,11 @@
 
 #pragma once
 
-#include <fmt/format.h>
+#include <atomic>
+#include <cstring>
 #include <lunatic/integer.hpp>
+#include <mutex>
+#include <thread>
 
 #ifdef _WIN32
   #define WIN32_LEAN_AND_MEAN
@@ -22,14 +25,34 @@ namespace lunatic {
 // T = data-type for object IDs (local to a pool)
 // capacity = number of objects in a pool
 // size = size of each object
+//
+// Each thread has its own allocator, which allocates without synchronization.
+// Objects may be released on any thread: objects released by another thread are queued
+// and returned to their pool by the owning thread, once it allocates again.
+// After the owning thread has exited, its allocator lives on until all its objects are released.
 template<typename T, size_t capacity, size_t size>
 struct PoolAllocator {
   static constexpr size_t max_size = size;
 
+  static_assert(size >= sizeof(void*), "PoolAllocator: objects must be able to hold a pointer");
+
+  /// Returns the allocator of the calling thread.
+  static auto Get() -> PoolAllocator& {
+    thread_local ThreadHandle handle;
+
+    return *handle.allocator;
+  }
+
   auto Allocate() -> void* {
+    if (has_remote_releases.load(std::memory_order_acquire)) {
+      ReleaseRemoteObjects();
+    }
+
     if (free_pools.head == nullptr) {
       free_pools.head = new Pool{};
       free_pools.tail = free_pools.head;
+      free_pools.head->allocator = this;
+      number_of_pools++;
     }
 
     auto pool = free_pools.head;
@@ -46,8 +69,85 @@ struct PoolAllocator {
     return object;
   }
 
-  void Release(void* object) {
+  static void Release(void* object) {
     auto obj = (typename Pool::Object*)object;
+    auto allocator = ((Pool*)(obj - obj->id))->allocator;
+
+    if (allocator->owner.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+      allocator->ReleaseLocal(obj);
+      return;
+    }
+
+    auto lock = std::unique_lock{allocator->mutex};
+
+    if (allocator->owner.load(std::memory_order_relaxed) != std::thread::id{}) {
+      // Let the owning thread return the object to its pool, since it modifies the pools without locking.
+      std::memcpy(obj->data, &allocator->remote_releases, sizeof(void*));
+      allocator->remote_releases = obj;
+      allocator->has_remote_releases.store(true, std::memory_order_release);
+    } else {
+      // The owning thread has exited, so the pools are only modified under the lock.
+      allocator->ReleaseLocal(obj);
+
+      if (allocator->number_of_pools == 0) {
+        lock.unlock();
+        delete allocator;
+      }
+    }
+  }
+
+private:
+  struct Pool;
+
+  struct ThreadHandle {
+    ThreadHandle() : allocator(new PoolAllocator{}) {}
+
+   ~ThreadHandle() {
+      auto lock = std::unique_lock{allocator->mutex};
+
+      allocator->owner = std::thread::id{};
+      allocator->ReleaseObjects(allocator->TakeRemoteReleases());
+
+      // Objects, which are still alive, keep the allocator alive.
+      if (allocator->number_of_pools == 0) {
+        lock.unlock();
+        delete allocator;
+      }
+    }
+
+    PoolAllocator* allocator;
+  };
+
+  PoolAllocator() : owner(std::this_thread::get_id()) {}
+
+  void ReleaseRemoteObjects() {
+    auto lock = std::unique_lock{mutex};
+    auto objects = TakeRemoteReleases();
+
+    lock.unlock();
+    ReleaseObjects(objects);
+  }
+
+  // Must be called with the mutex held.
+  auto TakeRemoteReleases() -> typename Pool::Object* {
+    auto objects = remote_releases;
+
+    remote_releases = nullptr;
+    has_remote_releases.store(false, std::memory_order_relaxed);
+    return objects;
+  }
+
+  void ReleaseObjects(typename Pool::Object* obj) {
+    while (obj != nullptr) {
+      auto next_obj = (typename Pool::Object*)nullptr;
+
+      std::memcpy(&next_obj, obj->data, sizeof(void*));
+      ReleaseLocal(obj);
+      obj = next_obj;
+    }
+  }
+
+  void ReleaseLocal(typename Pool::Object* obj) {
     auto pool = (Pool*)(obj - obj->id);
 
     if (pool->IsFull()) {
@@ -65,10 +165,10 @@ struct PoolAllocator {
     if (pool->IsEmpty()) {
       free_pools.Remove(pool);
       delete pool;
+      number_of_pools--;
     }
   }
 
-private:
   struct Pool {
     Pool() {
       T invert = capacity - 1;
@@ -114,6 +214,7 @@ private:
       size_t length;
     } stack;
 
+    PoolAllocator* allocator = nullptr;
     Pool* prev = nullptr;
     Pool* next = nullptr;
   };
@@ -171,34 +272,37 @@ private:
 
   List free_pools;
   List full_pools;
+  size_t number_of_pools = 0;
+
+  std::atomic<std::thread::id> owner;
+  std::mutex mutex;
+  typename Pool::Object* remote_releases = nullptr;
+  std::atomic_bool has_remote_releases = false;
 };
 
-extern PoolAllocator<u16, 4096, 134> g_pool_alloc;
+/**
+ * Allocate an object from the size class that fits it, using the pools of the calling thread.
+ * Objects larger than the largest size class are allocated from the heap.
+ */
+auto PoolAllocate(size_t size) -> void*;
+
+/// Release an object from any thread, given the size which it was allocated with.
+void PoolRelease(void* object, size_t size);
 
 struct PoolObject {
   auto operator new(size_t size) -> void* {
-#ifndef NDEBUG
-    if (size > decltype(g_pool_alloc)::max_size) {
-      throw std::runtime_error(
-        fmt::format("PoolObject: requested size ({}) is larger than the supported maximum ({})",
-          size, decltype(g_pool_alloc)::max_size));
-    }
-#endif
-    return g_pool_alloc.Allocate();
+    return PoolAllocate(size);
   }
 
-  void operator delete(void* object) {
-    g_pool_alloc.Release(object);
+  void operator delete(void* object, size_t size) {
+    PoolRelease(object, size);
   }
 };
 
-// Wrapper around our g_pool_alloc that implements the 'Allocator' named requirements:
+// Wrapper around PoolAllocate() and PoolRelease() that implements the 'Allocator' named requirements:
 // https://en.cppreference.com/w/cpp/named_req/Allocator
 template<typename T>
 struct StdPoolAlloc {
-  static_assert(sizeof(T) <= decltype(g_pool_alloc)::max_size,
-    "StdPoolAlloc: type exceeds maxmimum supported allocation size");
-
   using value_type = T;
 
   StdPoolAlloc() = default;
@@ -215,11 +319,11 @@ struct StdPoolAlloc {
   }
 
   auto allocate(std::size_t n) -> T* {
-    return (T*)g_pool_alloc.Allocate();
+    return (T*)PoolAllocate(n * sizeof(T));
   }
 
   void deallocate(T* p, size_t n) {
-    g_pool_alloc.Release(p);
+    PoolRelease(p, n * sizeof(T));
   }
 };
 
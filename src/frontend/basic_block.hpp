@@ -11,6 +11,7 @@
 #include <lunatic/integer.hpp>
 #include <vector>
 
+#include "common/intrusive_list.hpp"
 #include "common/pool_allocator.hpp"
 #include "decode/definition/common.hpp"
 #include "ir/emitter.hpp"
@@ -89,7 +90,7 @@ struct BasicBlock : PoolObject {
     return key != other.key;
   }
 
-  void RegisterReleaseCallback(std::function<void(BasicBlock const&)> const& callback) {
+  void RegisterReleaseCallback(std::function<void(BasicBlock&)> const& callback) {
     release_callbacks.push_back(callback);
   }
 
@@ -103,23 +104,63 @@ struct BasicBlock : PoolObject {
 
   std::vector<MicroBlock> micro_blocks;
 
-  // Pointer to the compiled code.
+  // Pointer to the compiled code and its size in bytes.
   CompiledFn function = (CompiledFn)0;
+  size_t function_size = 0;
+
+  /* Offsets into the compiled code at which the code for a guest instruction begins.
+   * Each entry covers the code up to the next entry. This is used by the sampling profiler.
+   */
+  struct HostMapping {
+    u32 host_offset;
+    u32 guest_address;
+  };
+
+  std::vector<HostMapping> host_mapping;
 
-  struct BranchTarget {
+  /* The list node links the jump to the branch target either into the incoming links of the target block,
+   * or into the list of jumps which wait for the target block to be compiled.
+   */
+  struct BranchTarget : IntrusiveListNode {
     Key key{};
     u8* patch_location = nullptr;
     Condition condition = Condition::AL;
   } branch_target;
 
-  std::vector<BasicBlock*> linking_blocks;
+  // The successor of a conditional branch, which is executed if the branch is not taken.
+  BranchTarget fallthrough_target;
+
+  // Jumps of basic blocks (see BranchTarget), which have been patched to jump to this block.
+  IntrusiveListNode incoming_links;
+
+  /* The instruction after the last translated instruction, in the mode and instruction set of the last instruction.
+   * This is not necessarily at key + length, because translation continues at the target of unconditional branches.
+   */
+  Key next_key{};
+
+  // The return addresses of the calls (BL, BLX and SWI) in the basic block.
+  std::vector<Key> return_keys;
+
+  // Consecutive bytes of guest code, which the basic block was translated from.
+  struct CodeRange {
+    u32 address;
+    u32 size;
+  };
+
+  // The guest code of the basic block in program order. There is more than one range if translation followed a branch.
+  std::vector<CodeRange> code_ranges;
 
   u32 hash = 0;
   bool enable_fast_dispatch = true;
   bool uses_exception_base = false;
+  bool is_idle_loop = false;
+
+  // NZCV flags (see FlagMask), which are overwritten before they are read on entry to and exit from the block.
+  u8 flags_dead_on_entry = 0;
+  u8 flags_dead_on_exit = 0;
 
 private:
-  std::vector<std::function<void(BasicBlock const&)>> release_callbacks;
+  std::vector<std::function<void(BasicBlock&)>> release_callbacks;
 };
 
 } // namespace lunatic::frontend
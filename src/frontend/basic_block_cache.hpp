@@ -7,12 +7,20 @@
 
 #pragma once
 
+#include <algorithm>
+#include <memory>
+
 #include "basic_block.hpp"
 
 namespace lunatic {
 namespace frontend {
 
 struct BasicBlockCache {
+  BasicBlockCache() : empty_entry_points(new BasicBlock::CompiledFn[0x80000]) {
+    std::fill_n(empty_entry_points.get(), 0x80000, dispatch_miss_handler);
+    std::fill_n(entry_points, 0x40000, empty_entry_points.get());
+  }
+
  ~BasicBlockCache() {
     /* Make sure that the cache does not consist of stale points,
      * once the basic blocks are deleted and X64Backend::OnBasicBlockToBeDeleted() will be called.
@@ -22,10 +30,20 @@ struct BasicBlockCache {
 
   void Flush() {
     for (int i = 0; i < 0x40000; i++) {
+      entry_points[i] = empty_entry_points.get();
       data[i] = {};
     }
   }
 
+  /**
+   * Set the code which compiled code dispatches to, if there is no basic block for a key.
+   * This must happen before any basic block is added to the cache.
+   */
+  void SetDispatchMissHandler(BasicBlock::CompiledFn handler) {
+    dispatch_miss_handler = handler;
+    std::fill_n(empty_entry_points.get(), 0x80000, handler);
+  }
+
   void Flush(u32 address_lo, u32 address_hi) {
     // bits  0 - 30: address[31:1]
     // bits 31 - 35: CPU mode
@@ -44,6 +62,21 @@ struct BasicBlockCache {
     }
   }
 
+  template<typename Functor>
+  void ForEach(Functor&& functor) const {
+    for (auto& table : data) {
+      if (table == nullptr) {
+        continue;
+      }
+
+      for (auto& block : table->data) {
+        if (block) {
+          functor(*block);
+        }
+      }
+    }
+  }
+
   auto Get(BasicBlock::Key key) const -> BasicBlock* {
     auto& table = data[key.value >> 19];
     if (table == nullptr) {
@@ -59,29 +92,37 @@ struct BasicBlockCache {
 
     if (table == nullptr) {
       data[hash0] = std::make_unique<Table>();
+      std::fill_n(table->entry_points, 0x80000, dispatch_miss_handler);
+      entry_points[hash0] = table->entry_points;
     }
 
+    /* The current block is released once the new block has been stored,
+     * which lets the backend redirect the jumps into it back to the dispatcher.
+     */
     auto current_block = std::move(table->data[hash1]);
 
-    // Temporary fix: remove any linked blocks from the cache as well.
-    if (current_block && current_block.get() != block) {
-      for (auto linking_block : current_block->linking_blocks) {
-        if (linking_block != current_block.get()) {
-          Set(linking_block->key, nullptr);
-        }
-      }
-    }
-
+    table->entry_points[hash1] = block ? block->function : dispatch_miss_handler;
     table->data[hash1] = std::unique_ptr<BasicBlock>{block};
   }
 
   struct Table {
     // int use_count = 0;
     std::unique_ptr<BasicBlock> data[0x80000];
+
+    // Compiled code of the basic blocks above, or the dispatch miss handler for empty slots.
+    BasicBlock::CompiledFn entry_points[0x80000];
   };
 
   // TODO: better manage the lifetimes of the tables.
   std::unique_ptr<Table> data[0x40000];
+
+  /* Compiled code dispatches through these tables, which hold the compiled code of the basic blocks directly.
+   * Slots without a table point to a table which only holds the dispatch miss handler,
+   * so that neither level needs to be checked for null pointers.
+   */
+  BasicBlock::CompiledFn* entry_points[0x40000];
+  std::unique_ptr<BasicBlock::CompiledFn[]> empty_entry_points;
+  BasicBlock::CompiledFn dispatch_miss_handler = 0;
 };
 
 } // namespace lunatic::frontend
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <array>
 #include <lunatic/integer.hpp>
 
 #include "common/bit.hpp"
@@ -360,29 +361,29 @@ inline auto decode_branch_link_exchange_relative(u32 opcode, T& client) -> U {
   return client.Handle(info);
 }
 
-} // namespace lunatic::frontend::detail
-
-/// Decodes an ARM opcode into one of multiple structures,
-/// passes the resulting structure to a client and returns the client's return value.
-template<typename T, typename U = typename T::return_type>
-inline auto decode_arm(u32 instruction, T& client) -> U {
-  auto opcode = instruction & 0x0FFFFFFF;
-  auto condition = bit::get_field<u32, Condition>(instruction, 28, 4);
-
-  using namespace detail;
-
-  // TODO: do not decode unconditional opcodes on ARMv4T
-  if (condition == Condition::NV) {
-    // NOTE: PLD is stubbed and treated like mov r0, r0
-    switch(opcode >> 25) {
-      case 0b010: return decode_data_processing(Condition::AL, 0x01A00000u, client); // PLD #imm
-      case 0b011: return decode_data_processing(Condition::AL, 0x01A00000u, client); // PLD reg
-      case 0b101: return decode_branch_link_exchange_relative(opcode, client);
-    }
-
-    return client.Undefined(instruction);
-  }
+enum class ARMInstrType : u8 {
+  DataProcessing,
+  MoveStatusRegister,
+  MoveRegisterStatus,
+  Multiply,
+  MultiplyLong,
+  SingleDataSwap,
+  BranchExchange,
+  HalfwordSignedTransfer,
+  SingleDataTransfer,
+  BlockDataTransfer,
+  BranchRelative,
+  CoprocessorRegisterTransfer,
+  SVC,
+  CountLeadingZeros,
+  SaturatingAddSub,
+  SignedHalfwordMultiply,
+  Undefined
+};
 
+/// Determines which decode function handles an opcode.
+/// The result only depends on the bits 27-20 and 7-4 of the opcode.
+constexpr auto classify_arm(u32 opcode) -> ARMInstrType {
   switch (opcode >> 25) {
     case 0b000: {
       // Data processing immediate shift
@@ -398,83 +399,81 @@ inline auto decode_arm(u32 instruction, T& client) -> U {
         // Multiplies (A3-3)
         // Extra load/stores (A3-5)
         if ((opcode & 0x60) != 0) {
-          return decode_halfword_signed_transfer(condition, opcode, client);
+          return ARMInstrType::HalfwordSignedTransfer;
         } else {
           switch ((opcode >> 23) & 3) {
             case 0b00:
             case 0b01: {
-              auto op = bit::get_field(opcode, 21, 4);
-              switch (op) {
+              switch (bit::get_field(opcode, 21, 4)) {
                 case 0b000:
                 case 0b001:
                   // MUL, MLA
-                  return decode_multiply(condition, opcode, client);
+                  return ARMInstrType::Multiply;
                 case 0b100:
                 case 0b101:
                 case 0b110:
                 case 0b111:
                   // UMULL, UMLAL, SMULL, SMLAL
-                  return decode_multiply_long(condition, opcode, client);
+                  return ARMInstrType::MultiplyLong;
                 default:
-                  return client.Undefined(instruction);
+                  return ARMInstrType::Undefined;
               }
             }
             case 0b10:
-              return decode_single_data_swap(condition, opcode, client);
+              return ARMInstrType::SingleDataSwap;
             case 0b11:
-              // return ARMInstrType::LoadStoreExclusive;
-              return client.Undefined(instruction);
+              // Load/store exclusive
+              return ARMInstrType::Undefined;
           }
         }
       } else if (!set_flags && opcode2 >= 0b1000 && opcode2 <= 0b1011) {
         // Miscellaneous instructions (A3-4)
         if ((opcode & 0xF0) == 0) {
-          // return ARMInstrType::StatusTransfer;
           if (bit::get_bit(opcode, 21)) {
-            return decode_move_status_register(condition, opcode, client);
+            return ARMInstrType::MoveStatusRegister;
           }
-          return decode_move_register_status(condition, opcode, client);
+          return ARMInstrType::MoveRegisterStatus;
         }
 
         if ((opcode & 0x6000F0) == 0x200010) {
           // Branch and exchange (no link)
-          return decode_branch_exchange(condition, opcode, client);
+          return ARMInstrType::BranchExchange;
         }
 
         if ((opcode & 0x6000F0) == 0x200020) {
-          // return ARMInstrType::BranchAndExchangeJazelle;
-          return client.Undefined(instruction);
+          // Branch and exchange Jazelle
+          return ARMInstrType::Undefined;
         }
 
         if ((opcode & 0x6000F0) == 0x600010) {
           // TODO: do not decode this instruction on ARMv4T
-          return decode_count_leading_zeros(condition, opcode, client);
+          return ARMInstrType::CountLeadingZeros;
         }
 
         if ((opcode & 0x6000F0) == 0x200030) {
           // Branch and exchange with link
-          return decode_branch_exchange(condition, opcode, client);
+          return ARMInstrType::BranchExchange;
         }
 
         if ((opcode & 0xF0) == 0x50) {
-          return decode_saturating_add_sub(condition, opcode, client);
+          return ARMInstrType::SaturatingAddSub;
         }
 
         if ((opcode & 0x6000F0) == 0x200070) {
-          // return ARMInstrType::Breakpoint;
-          return client.Undefined(instruction);
+          // Breakpoint
+          return ARMInstrType::Undefined;
         }
 
         if ((opcode & 0x90) == 0x80) {
           // Signed halfword multiply (ARMv5 upwards):
           // SMLAxy, SMLAWy, SMULWy, SMLALxy, SMULxy
-          return decode_signed_halfword_multiply(condition, opcode, client);
+          return ARMInstrType::SignedHalfwordMultiply;
         }
       }
 
       // Data processing immediate shift
       // Data processing register shift
-      return decode_data_processing(condition, opcode, client);
+      return ARMInstrType::DataProcessing;
     }
     case 0b001: {
       // Data processing immediate
@@ -488,61 +487,115 @@ inline auto decode_arm(u32 instruction, T& client) -> U {
         switch (opcode2) {
           case 0b1000:
           case 0b1010:
-            // return ARMInstrType::Undefined;
-            return client.Undefined(instruction);
+            return ARMInstrType::Undefined;
           case 0b1001:
           case 0b1011:
-            // return ARMInstrType::StatusTransfer;
-            return decode_move_status_register(condition, opcode, client);
+            return ARMInstrType::MoveStatusRegister;
         }
       }
 
-      return decode_data_processing(condition, opcode, client);
+      return ARMInstrType::DataProcessing;
     }
     case 0b010: {
       // Load/store immediate offset
-      return decode_single_data_transfer(condition, opcode, client);
+      return ARMInstrType::SingleDataTransfer;
     }
     case 0b011: {
       // Load/store register offset
       // Media instructions
       // Architecturally Undefined
       if (opcode & 0x10) {
-        // return ARMInstrType::Media;
-        return client.Undefined(instruction);
+        // Media instructions
+        return ARMInstrType::Undefined;
       }
 
-      return decode_single_data_transfer(condition, opcode, client);
+      return ARMInstrType::SingleDataTransfer;
     }
     case 0b100: {
       // Load/store multiple
-      return decode_block_data_transfer(condition, opcode, client);
+      return ARMInstrType::BlockDataTransfer;
     }
     case 0b101: {
       // Branch and branch with link
-      return decode_branch_relative(condition, opcode, client);
+      return ARMInstrType::BranchRelative;
     }
     case 0b110: {
       // Coprocessor load/store and double register transfers
       // TODO: differentiate between load/store and double reg transfer instructions.
-      // return ARMInstrType::CoprocessorLoadStoreAndDoubleRegXfer;
-      return client.Undefined(instruction);
+      return ARMInstrType::Undefined;
     }
     case 0b111: {
       // Coprocessor data processing
       // Coprocessor register transfers
       // Software interrupt
       if ((opcode & 0x1000010) == 0) {
-        // return ARMInstrType::CoprocessorDataProcessing;
-        return client.Undefined(instruction);
+        // Coprocessor data processing
+        return ARMInstrType::Undefined;
       }
 
       if ((opcode & 0x1000010) == 0x10) {
-        return decode_coprocessor_register_transfer(condition, opcode, client);
+        return ARMInstrType::CoprocessorRegisterTransfer;
       }
 
-      return decode_svc(condition, opcode, client);
+      return ARMInstrType::SVC;
+    }
+  }
+
+  return ARMInstrType::Undefined;
+}
+
+/// Maps the bits 27-20 and 7-4 of an opcode to the decode function, which handles the opcode.
+inline constexpr auto kARMDecodeTable = []() {
+  auto table = std::array<ARMInstrType, 4096>{};
+
+  for (u32 i = 0; i < 4096; i++) {
+    table[i] = classify_arm(((i & 0xFF0) << 16) | ((i & 0xF) << 4));
+  }
+
+  return table;
+}();
+
+} // namespace lunatic::frontend::detail
+
+/// Decodes an ARM opcode into one of multiple structures,
+/// passes the resulting structure to a client and returns the client's return value.
+template<typename T, typename U = typename T::return_type>
+inline auto decode_arm(u32 instruction, T& client) -> U {
+  auto opcode = instruction & 0x0FFFFFFF;
+  auto condition = bit::get_field<u32, Condition>(instruction, 28, 4);
+
+  using namespace detail;
+
+  // TODO: do not decode unconditional opcodes on ARMv4T
+  if (condition == Condition::NV) {
+    // NOTE: PLD is stubbed and treated like mov r0, r0
+    switch(opcode >> 25) {
+      case 0b010: return decode_data_processing(Condition::AL, 0x01A00000u, client); // PLD #imm
+      case 0b011: return decode_data_processing(Condition::AL, 0x01A00000u, client); // PLD reg
+      case 0b101: return decode_branch_link_exchange_relative(opcode, client);
     }
+
+    return client.Undefined(instruction);
+  }
+
+  switch (kARMDecodeTable[((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0xF)]) {
+    case ARMInstrType::DataProcessing: return decode_data_processing(condition, opcode, client);
+    case ARMInstrType::MoveStatusRegister: return decode_move_status_register(condition, opcode, client);
+    case ARMInstrType::MoveRegisterStatus: return decode_move_register_status(condition, opcode, client);
+    case ARMInstrType::Multiply: return decode_multiply(condition, opcode, client);
+    case ARMInstrType::MultiplyLong: return decode_multiply_long(condition, opcode, client);
+    case ARMInstrType::SingleDataSwap: return decode_single_data_swap(condition, opcode, client);
+    case ARMInstrType::BranchExchange: return decode_branch_exchange(condition, opcode, client);
+    case ARMInstrType::HalfwordSignedTransfer: return decode_halfword_signed_transfer(condition, opcode, client);
+    case ARMInstrType::SingleDataTransfer: return decode_single_data_transfer(condition, opcode, client);
+    case ARMInstrType::BlockDataTransfer: return decode_block_data_transfer(condition, opcode, client);
+    case ARMInstrType::BranchRelative: return decode_branch_relative(condition, opcode, client);
+    case ARMInstrType::CoprocessorRegisterTransfer: return decode_coprocessor_register_transfer(condition, opcode, client);
+    case ARMInstrType::SVC: return decode_svc(condition, opcode, client);
+    case ARMInstrType::CountLeadingZeros: return decode_count_leading_zeros(condition, opcode, client);
+    case ARMInstrType::SaturatingAddSub: return decode_saturating_add_sub(condition, opcode, client);
+    case ARMInstrType::SignedHalfwordMultiply: return decode_signed_halfword_multiply(condition, opcode, client);
+    case ARMInstrType::Undefined: break;
   }
 
   return client.Undefined(instruction);
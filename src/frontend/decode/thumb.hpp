@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <array>
 #include <lunatic/integer.hpp>
 
 #include "arm.hpp"
@@ -521,6 +522,71 @@ inline auto decode_branch_link_full(u32 opcode, T& client) -> U {
   return client.Handle(info);
 }
 
+enum class ThumbInstrType : u8 {
+  MoveShiftedRegister,
+  AddSub,
+  MovCmpAddSubImm,
+  ALU,
+  HighRegisterOps,
+  LoadRelativePC,
+  LoadStoreOffsetReg,
+  LoadStoreSigned,
+  LoadStoreOffsetImm,
+  LoadStoreHalf,
+  LoadStoreRelativeSP,
+  LoadAddress,
+  AddSPOffset,
+  PushPop,
+  LdmStm,
+  ConditionalBranch,
+  SVC,
+  UnconditionalBranch,
+  BranchLinkSuffixExchange,
+  BranchLinkPrefix,
+  BranchLinkSuffix,
+  Undefined
+};
+
+/// Determines which decode function handles an opcode.
+/// The result only depends on the bits 15-8 of the opcode.
+constexpr auto classify_thumb(u16 opcode) -> ThumbInstrType {
+  if ((opcode & 0xF800) <  0x1800) return ThumbInstrType::MoveShiftedRegister;
+  if ((opcode & 0xF800) == 0x1800) return ThumbInstrType::AddSub;
+  if ((opcode & 0xE000) == 0x2000) return ThumbInstrType::MovCmpAddSubImm;
+  if ((opcode & 0xFC00) == 0x4000) return ThumbInstrType::ALU;
+  if ((opcode & 0xFC00) == 0x4400) return ThumbInstrType::HighRegisterOps;
+  if ((opcode & 0xF800) == 0x4800) return ThumbInstrType::LoadRelativePC;
+  if ((opcode & 0xF200) == 0x5000) return ThumbInstrType::LoadStoreOffsetReg;
+  if ((opcode & 0xF200) == 0x5200) return ThumbInstrType::LoadStoreSigned;
+  if ((opcode & 0xE000) == 0x6000) return ThumbInstrType::LoadStoreOffsetImm;
+  if ((opcode & 0xF000) == 0x8000) return ThumbInstrType::LoadStoreHalf;
+  if ((opcode & 0xF000) == 0x9000) return ThumbInstrType::LoadStoreRelativeSP;
+  if ((opcode & 0xF000) == 0xA000) return ThumbInstrType::LoadAddress;
+  if ((opcode & 0xFF00) == 0xB000) return ThumbInstrType::AddSPOffset;
+  if ((opcode & 0xF600) == 0xB400) return ThumbInstrType::PushPop;
+//if ((opcode & 0xFF00) == 0xBE00) return ThumbInstrType::SoftwareBreakpoint;
+  if ((opcode & 0xF000) == 0xC000) return ThumbInstrType::LdmStm;
+  if ((opcode & 0xFF00) <  0xDF00) return ThumbInstrType::ConditionalBranch;
+  if ((opcode & 0xFF00) == 0xDF00) return ThumbInstrType::SVC;
+  if ((opcode & 0xF800) == 0xE000) return ThumbInstrType::UnconditionalBranch;
+  if ((opcode & 0xF800) == 0xE800) return ThumbInstrType::BranchLinkSuffixExchange;
+  if ((opcode & 0xF800) == 0xF000) return ThumbInstrType::BranchLinkPrefix;
+  if ((opcode & 0xF800) == 0xF800) return ThumbInstrType::BranchLinkSuffix;
+
+  return ThumbInstrType::Undefined;
+}
+
+/// Maps the bits 15-8 of an opcode to the decode function, which handles the opcode.
+inline constexpr auto kThumbDecodeTable = []() {
+  auto table = std::array<ThumbInstrType, 256>{};
+
+  for (u32 i = 0; i < 256; i++) {
+    table[i] = classify_thumb(u16(i << 8));
+  }
+
+  return table;
+}();
+
 } // namespace lunatic::frontend::detail
 
 /// Decodes a Thumb opcode into one of multiple structures,
@@ -533,28 +599,30 @@ inline auto decode_thumb(u32 opcode, T& client) -> U {
     return decode_branch_link_full(opcode, client);
   }
 
-  if ((opcode & 0xF800) <  0x1800) return decode_move_shifted_register(opcode, client);
-  if ((opcode & 0xF800) == 0x1800) return decode_add_sub(opcode, client);
-  if ((opcode & 0xE000) == 0x2000) return decode_mov_cmp_add_sub_imm(opcode, client);
-  if ((opcode & 0xFC00) == 0x4000) return decode_alu(opcode, client);
-  if ((opcode & 0xFC00) == 0x4400) return decode_high_register_ops(opcode, client);
-  if ((opcode & 0xF800) == 0x4800) return decode_load_relative_pc(opcode, client);
-  if ((opcode & 0xF200) == 0x5000) return decode_load_store_offset_reg(opcode, client);
-  if ((opcode & 0xF200) == 0x5200) return decode_load_store_signed(opcode, client);
-  if ((opcode & 0xE000) == 0x6000) return decode_load_store_offset_imm(opcode, client);
-  if ((opcode & 0xF000) == 0x8000) return decode_load_store_half(opcode, client);
-  if ((opcode & 0xF000) == 0x9000) return decode_load_store_relative_sp(opcode, client);
-  if ((opcode & 0xF000) == 0xA000) return decode_load_address(opcode, client);
-  if ((opcode & 0xFF00) == 0xB000) return decode_add_sp_offset(opcode, client);
-  if ((opcode & 0xF600) == 0xB400) return decode_push_pop(opcode, client);
-//if ((opcode & 0xFF00) == 0xBE00) return ThumbInstrType::SoftwareBreakpoint;
-  if ((opcode & 0xF000) == 0xC000) return decode_ldm_stm(opcode, client);
-  if ((opcode & 0xFF00) <  0xDF00) return decode_conditional_branch(opcode, client);
-  if ((opcode & 0xFF00) == 0xDF00) return decode_svc(opcode, client);
-  if ((opcode & 0xF800) == 0xE000) return decode_unconditional_branch(opcode, client);
-  if ((opcode & 0xF800) == 0xE800) return decode_branch_link_suffix(opcode, client, true);
-  if ((opcode & 0xF800) == 0xF000) return decode_branch_link_prefix(opcode, client);
-  if ((opcode & 0xF800) == 0xF800) return decode_branch_link_suffix(opcode, client, false);
+  switch (kThumbDecodeTable[(opcode >> 8) & 0xFF]) {
+    case ThumbInstrType::MoveShiftedRegister: return decode_move_shifted_register(opcode, client);
+    case ThumbInstrType::AddSub: return decode_add_sub(opcode, client);
+    case ThumbInstrType::MovCmpAddSubImm: return decode_mov_cmp_add_sub_imm(opcode, client);
+    case ThumbInstrType::ALU: return decode_alu(opcode, client);
+    case ThumbInstrType::HighRegisterOps: return decode_high_register_ops(opcode, client);
+    case ThumbInstrType::LoadRelativePC: return decode_load_relative_pc(opcode, client);
+    case ThumbInstrType::LoadStoreOffsetReg: return decode_load_store_offset_reg(opcode, client);
+    case ThumbInstrType::LoadStoreSigned: return decode_load_store_signed(opcode, client);
+    case ThumbInstrType::LoadStoreOffsetImm: return decode_load_store_offset_imm(opcode, client);
+    case ThumbInstrType::LoadStoreHalf: return decode_load_store_half(opcode, client);
+    case ThumbInstrType::LoadStoreRelativeSP: return decode_load_store_relative_sp(opcode, client);
+    case ThumbInstrType::LoadAddress: return decode_load_address(opcode, client);
+    case ThumbInstrType::AddSPOffset: return decode_add_sp_offset(opcode, client);
+    case ThumbInstrType::PushPop: return decode_push_pop(opcode, client);
+    case ThumbInstrType::LdmStm: return decode_ldm_stm(opcode, client);
+    case ThumbInstrType::ConditionalBranch: return decode_conditional_branch(opcode, client);
+    case ThumbInstrType::SVC: return decode_svc(opcode, client);
+    case ThumbInstrType::UnconditionalBranch: return decode_unconditional_branch(opcode, client);
+    case ThumbInstrType::BranchLinkSuffixExchange: return decode_branch_link_suffix(opcode, client, true);
+    case ThumbInstrType::BranchLinkPrefix: return decode_branch_link_prefix(opcode, client);
+    case ThumbInstrType::BranchLinkSuffix: return decode_branch_link_suffix(opcode, client, false);
+    case ThumbInstrType::Undefined: break;
+  }
 
   return client.Undefined(opcode); // TODO: distinguish ARM and Thumb opcodes.
 }
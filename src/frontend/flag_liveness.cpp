@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include "flag_liveness.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+struct FlagUsage {
+  // Flags which are read before the micro block overwrites them.
+  u8 read = 0;
+
+  // Flags which are overwritten whenever the micro block is entered.
+  u8 overwritten = 0;
+};
+
+auto GetFlagsReadByCondition(Condition condition) -> u8 {
+  switch (condition) {
+    case Condition::EQ:
+    case Condition::NE: return kFlagZ;
+    case Condition::CS:
+    case Condition::CC: return kFlagC;
+    case Condition::MI:
+    case Condition::PL: return kFlagN;
+    case Condition::VS:
+    case Condition::VC: return kFlagV;
+    case Condition::HI:
+    case Condition::LS: return kFlagC | kFlagZ;
+    case Condition::GE:
+    case Condition::LT: return kFlagN | kFlagV;
+    case Condition::GT:
+    case Condition::LE: return kFlagN | kFlagZ | kFlagV;
+    default: return 0;
+  }
+}
+
+auto GetFlagsWrittenByUpdate(IRUpdateFlags const& update) -> u8 {
+  u8 flags = 0;
+
+  if (update.flag_n) flags |= kFlagN;
+  if (update.flag_z) flags |= kFlagZ;
+  if (update.flag_c) flags |= kFlagC;
+  if (update.flag_v) flags |= kFlagV;
+  return flags;
+}
+
+static bool ReadsHostCarry(IROpcode* op) {
+  switch (op->GetClass()) {
+    case IROpcodeClass::ADC:
+    case IROpcodeClass::SBC:
+    case IROpcodeClass::RSC: {
+      return true;
+    }
+    case IROpcodeClass::ROR: {
+      auto& amount = lunatic_cast<IRRotateRight>(op)->amount;
+
+      // ROR #0 encodes RRX, which shifts in the carry flag.
+      return amount.IsConstant() && amount.GetConst().value == 0;
+    }
+    default: return false;
+  }
+}
+
+static bool WritesHostCarry(IROpcode* op) {
+  auto check = [](auto shift, bool is_ror) {
+    auto& amount = shift->amount;
+
+    // The carry flag is not modified if the shift amount is zero, except for RRX.
+    return shift->update_host_flags && amount.IsConstant() && (is_ror || amount.GetConst().value != 0);
+  };
+
+  switch (op->GetClass()) {
+    case IROpcodeClass::ClearCarry:
+    case IROpcodeClass::SetCarry: return true;
+    case IROpcodeClass::LSL: return check(lunatic_cast<IRLogicalShiftLeft>(op), false);
+    case IROpcodeClass::LSR: return check(lunatic_cast<IRLogicalShiftRight>(op), false);
+    case IROpcodeClass::ASR: return check(lunatic_cast<IRArithmeticShiftRight>(op), false);
+    case IROpcodeClass::ROR: return check(lunatic_cast<IRRotateRight>(op), true);
+    case IROpcodeClass::SUB: return lunatic_cast<IRSub>(op)->update_host_flags;
+    case IROpcodeClass::RSB: return lunatic_cast<IRRsb>(op)->update_host_flags;
+    case IROpcodeClass::ADD: return lunatic_cast<IRAdd>(op)->update_host_flags;
+    case IROpcodeClass::ADC: return lunatic_cast<IRAdc>(op)->update_host_flags;
+    case IROpcodeClass::SBC: return lunatic_cast<IRSbc>(op)->update_host_flags;
+    case IROpcodeClass::RSC: return lunatic_cast<IRRsc>(op)->update_host_flags;
+    case IROpcodeClass::MUL: return lunatic_cast<IRMultiply>(op)->update_host_flags;
+    case IROpcodeClass::ADD64: return lunatic_cast<IRAdd64>(op)->update_host_flags;
+    default: return false;
+  }
+}
+
+static auto GetFlagUsage(BasicBlock::MicroBlock const& micro_block) -> FlagUsage {
+  auto usage = FlagUsage{};
+  auto& emitter = micro_block.emitter;
+  bool conditional = micro_block.condition != Condition::AL;
+
+  /* The host carry flag is not reloaded from the CPSR by update.nzcv opcodes.
+   * Until it is written in the micro block, it holds the carry flag from before the micro block.
+   */
+  bool host_carry_written = false;
+
+  // Variables which hold a CPSR value with the flags left intact.
+  auto cpsr_vars = std::vector<bool>(emitter.Vars().size());
+
+  auto read = [&](u8 flags) {
+    usage.read |= flags & ~usage.overwritten;
+  };
+
+  // Bitwise opcodes leave the flags intact, if their constant operand does not modify bits 28 - 31.
+  auto forward_bitwise = [&](auto op, u32 neutral_flag_bits) {
+    if (cpsr_vars[op->lhs.Get().id] && op->result.HasValue() && op->rhs.IsConstant() &&
+        (op->rhs.GetConst().value & 0xF0000000) == neutral_flag_bits) {
+      cpsr_vars[op->result.Unwrap().id] = true;
+      return true;
+    }
+    return false;
+  };
+
+  read(GetFlagsReadByCondition(micro_block.condition));
+
+  for (auto const& op_ptr : emitter.Code()) {
+    auto op = op_ptr.get();
+    bool forwards_cpsr = false;
+
+    if (ReadsHostCarry(op) && !host_carry_written) {
+      read(kFlagC);
+    }
+
+    switch (op->GetClass()) {
+      case IROpcodeClass::LoadCPSR: {
+        cpsr_vars[lunatic_cast<IRLoadCPSR>(op)->result.Get().id] = true;
+        forwards_cpsr = true;
+        break;
+      }
+      case IROpcodeClass::StoreCPSR:
+      case IROpcodeClass::Flush: {
+        // IRFlush only reads the thumb bit.
+        forwards_cpsr = true;
+        break;
+      }
+      case IROpcodeClass::UpdateFlags: {
+        auto update = lunatic_cast<IRUpdateFlags>(op);
+        auto flags = GetFlagsWrittenByUpdate(*update);
+
+        if (update->flag_c && !host_carry_written) {
+          read(kFlagC);
+        }
+
+        // Flags written by a conditional micro block may keep their old value.
+        if (!conditional) {
+          usage.overwritten |= flags;
+        }
+
+        cpsr_vars[update->result.Get().id] = true;
+        forwards_cpsr = true;
+        break;
+      }
+      case IROpcodeClass::UpdateSticky: {
+        cpsr_vars[lunatic_cast<IRUpdateSticky>(op)->result.Get().id] = true;
+        forwards_cpsr = true;
+        break;
+      }
+      case IROpcodeClass::FlushExchange: {
+        cpsr_vars[lunatic_cast<IRFlushExchange>(op)->cpsr_out.Get().id] = true;
+        forwards_cpsr = true;
+        break;
+      }
+      case IROpcodeClass::AND: forwards_cpsr = forward_bitwise(lunatic_cast<IRBitwiseAND>(op), 0xF0000000); break;
+      case IROpcodeClass::BIC: forwards_cpsr = forward_bitwise(lunatic_cast<IRBitwiseBIC>(op), 0); break;
+      case IROpcodeClass::EOR: forwards_cpsr = forward_bitwise(lunatic_cast<IRBitwiseEOR>(op), 0); break;
+      case IROpcodeClass::ORR: forwards_cpsr = forward_bitwise(lunatic_cast<IRBitwiseORR>(op), 0); break;
+      default: break;
+    }
+
+    // Any other opcode which reads a CPSR value (MRS, SPSR writes, ...) may observe all flags.
+    if (!forwards_cpsr) {
+      for (auto var : op->GetReads()) {
+        if (cpsr_vars[var->id]) {
+          read(kFlagsNZCV);
+        }
+      }
+    }
+
+    if (WritesHostCarry(op)) {
+      host_carry_written = true;
+    }
+  }
+
+  return usage;
+}
+
+// A flag is dead if it is overwritten before it is read, on all paths through the remaining micro blocks.
+static auto GetFlagsDeadOnMicroBlockEntry(BasicBlock::MicroBlock const& micro_block, u8 flags_dead_on_exit) -> u8 {
+  auto usage = GetFlagUsage(micro_block);
+
+  return (usage.overwritten | flags_dead_on_exit) & ~usage.read;
+}
+
+auto GetFlagsDeadOnEntry(BasicBlock const& basic_block) -> u8 {
+  auto const& micro_blocks = basic_block.micro_blocks;
+  u8 flags_dead = 0;
+
+  for (auto it = micro_blocks.rbegin(); it != micro_blocks.rend(); ++it) {
+    flags_dead = GetFlagsDeadOnMicroBlockEntry(*it, flags_dead);
+  }
+
+  return flags_dead;
+}
+
+auto GetFlagsDeadOnMicroBlockExit(BasicBlock const& basic_block, u8 flags_dead_on_exit) -> std::vector<u8> {
+  auto const& micro_blocks = basic_block.micro_blocks;
+  auto result = std::vector<u8>(micro_blocks.size());
+  u8 flags_dead = flags_dead_on_exit;
+
+  for (int i = int(micro_blocks.size()) - 1; i >= 0; i--) {
+    result[i] = flags_dead;
+    flags_dead = GetFlagsDeadOnMicroBlockEntry(micro_blocks[i], flags_dead);
+  }
+
+  return result;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
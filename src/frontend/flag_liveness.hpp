@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "basic_block.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+// Masks of the NZCV flags, in the order in which they are stored in the CPSR.
+enum FlagMask : u8 {
+  kFlagV = 1 << 0,
+  kFlagC = 1 << 1,
+  kFlagZ = 1 << 2,
+  kFlagN = 1 << 3,
+  kFlagsNZCV = kFlagN | kFlagZ | kFlagC | kFlagV
+};
+
+// Returns the flags which are evaluated by a condition code.
+auto GetFlagsReadByCondition(Condition condition) -> u8;
+
+// Returns the flags which are written by an update.nzcv opcode.
+auto GetFlagsWrittenByUpdate(IRUpdateFlags const& update) -> u8;
+
+/**
+ * Returns the flags which a basic block always overwrites before it reads them.
+ * A predecessor of the basic block does not need to compute these flags, if all of its successors overwrite them.
+ * The result only depends on the code of the basic block itself, not on its successors.
+ */
+auto GetFlagsDeadOnEntry(BasicBlock const& basic_block) -> u8;
+
+/**
+ * Returns the flags which are dead at the end of each micro block of a basic block,
+ * given the flags which are dead once the basic block has been exited.
+ */
+auto GetFlagsDeadOnMicroBlockExit(BasicBlock const& basic_block, u8 flags_dead_on_exit) -> std::vector<u8>;
+
+} // namespace lunatic::frontend
+} // namespace lunatic
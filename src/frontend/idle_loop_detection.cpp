@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "flag_liveness.hpp"
+#include "idle_loop_detection.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+static bool IsShiftUsingCarryIn(IROpcode* op) {
+  auto check = [](auto shift, bool is_ror) {
+    auto& amount = shift->amount;
+
+    // ROR #0 encodes RRX, which shifts in the carry flag.
+    if (is_ror && amount.IsConstant() && amount.GetConst().value == 0) {
+      return true;
+    }
+
+    // The carry flag is not modified if the shift amount is zero.
+    return shift->update_host_flags && (amount.IsVariable() || amount.GetConst().value == 0);
+  };
+
+  switch (op->GetClass()) {
+    case IROpcodeClass::LSL: return check(lunatic_cast<IRLogicalShiftLeft>(op), false);
+    case IROpcodeClass::LSR: return check(lunatic_cast<IRLogicalShiftRight>(op), false);
+    case IROpcodeClass::ASR: return check(lunatic_cast<IRArithmeticShiftRight>(op), false);
+    case IROpcodeClass::ROR: return check(lunatic_cast<IRRotateRight>(op), true);
+    default: return false;
+  }
+}
+
+static bool UpdatesHostFlags(IROpcode* op) {
+  switch (op->GetClass()) {
+    case IROpcodeClass::LSL: return lunatic_cast<IRLogicalShiftLeft>(op)->update_host_flags;
+    case IROpcodeClass::LSR: return lunatic_cast<IRLogicalShiftRight>(op)->update_host_flags;
+    case IROpcodeClass::ASR: return lunatic_cast<IRArithmeticShiftRight>(op)->update_host_flags;
+    case IROpcodeClass::ROR: return lunatic_cast<IRRotateRight>(op)->update_host_flags;
+    case IROpcodeClass::AND: return lunatic_cast<IRBitwiseAND>(op)->update_host_flags;
+    case IROpcodeClass::BIC: return lunatic_cast<IRBitwiseBIC>(op)->update_host_flags;
+    case IROpcodeClass::EOR: return lunatic_cast<IRBitwiseEOR>(op)->update_host_flags;
+    case IROpcodeClass::SUB: return lunatic_cast<IRSub>(op)->update_host_flags;
+    case IROpcodeClass::RSB: return lunatic_cast<IRRsb>(op)->update_host_flags;
+    case IROpcodeClass::ADD: return lunatic_cast<IRAdd>(op)->update_host_flags;
+    case IROpcodeClass::ORR: return lunatic_cast<IRBitwiseORR>(op)->update_host_flags;
+    case IROpcodeClass::MOV: return lunatic_cast<IRMov>(op)->update_host_flags;
+    case IROpcodeClass::MVN: return lunatic_cast<IRMvn>(op)->update_host_flags;
+    case IROpcodeClass::MUL: return lunatic_cast<IRMultiply>(op)->update_host_flags;
+    default: return false;
+  }
+}
+
+bool IsIdleLoop(BasicBlock const& basic_block) {
+  if (basic_block.branch_target.key != basic_block.key) {
+    return false;
+  }
+
+  /**
+   * Collect the guest registers which the loop writes to, excluding the program counter.
+   * If one of them is read as well, an iteration may depend on the result of the previous iteration.
+   */
+  auto written_gprs = std::vector<int>{};
+  bool writes_cpsr = false;
+
+  for (auto const& micro_block : basic_block.micro_blocks) {
+    for (auto const& op : micro_block.emitter.Code()) {
+      if (op->GetClass() == IROpcodeClass::StoreGPR) {
+        auto reg = lunatic_cast<IRStoreGPR>(op.get())->reg;
+
+        if (reg.reg != GPR::PC) {
+          written_gprs.push_back(reg.ID());
+        }
+      } else if (op->GetClass() == IROpcodeClass::StoreCPSR) {
+        writes_cpsr = true;
+      }
+    }
+  }
+
+  // Variables, which may hold a different value in each iteration of the loop.
+  auto tainted_vars = std::vector<IRVariable const*>{};
+  bool tainted_host_flags = false;
+  u8 flags_written = 0;
+
+  for (auto const& micro_block : basic_block.micro_blocks) {
+    // A condition, which reads a flag before this iteration has written it, depends on the previous iteration.
+    if ((GetFlagsReadByCondition(micro_block.condition) & ~flags_written) != 0) {
+      return false;
+    }
+
+    auto& emitter = micro_block.emitter;
+
+    // The flags which the update.nzcv opcodes have written into each CPSR value.
+    auto updated_flags = std::vector<u8>(emitter.Vars().size());
+
+    for (auto const& op_ptr : emitter.Code()) {
+      auto op = op_ptr.get();
+
+      auto reads_tainted_var = std::any_of(tainted_vars.begin(), tainted_vars.end(), [&](auto var) {
+        return op->Reads(*var);
+      });
+
+      bool taint_result = reads_tainted_var;
+
+      switch (op->GetClass()) {
+        case IROpcodeClass::NOP:
+        case IROpcodeClass::LoadSPSR:
+        case IROpcodeClass::ClearCarry:
+        case IROpcodeClass::SetCarry:
+        case IROpcodeClass::AND:
+        case IROpcodeClass::BIC:
+        case IROpcodeClass::EOR:
+        case IROpcodeClass::SUB:
+        case IROpcodeClass::RSB:
+        case IROpcodeClass::ADD:
+        case IROpcodeClass::ORR:
+        case IROpcodeClass::MOV:
+        case IROpcodeClass::MVN:
+        case IROpcodeClass::MUL:
+        case IROpcodeClass::ADD64:
+        case IROpcodeClass::CLZ:
+        case IROpcodeClass::MemoryRead: {
+          break;
+        }
+        case IROpcodeClass::LSL:
+        case IROpcodeClass::LSR:
+        case IROpcodeClass::ASR:
+        case IROpcodeClass::ROR: {
+          if (IsShiftUsingCarryIn(op)) {
+            return false;
+          }
+          break;
+        }
+        case IROpcodeClass::LoadGPR: {
+          auto reg = lunatic_cast<IRLoadGPR>(op)->reg;
+
+          taint_result = std::find(written_gprs.begin(), written_gprs.end(), reg.ID()) != written_gprs.end();
+          break;
+        }
+        case IROpcodeClass::LoadCPSR: {
+          taint_result = writes_cpsr;
+          break;
+        }
+        case IROpcodeClass::UpdateFlags: {
+          auto update = lunatic_cast<IRUpdateFlags>(op);
+
+          // The flags are overwritten, so only the host flags matter, not the input CPSR.
+          taint_result = tainted_host_flags;
+          updated_flags[update->result.Get().id] = updated_flags[update->input.Get().id] | GetFlagsWrittenByUpdate(*update);
+          break;
+        }
+        case IROpcodeClass::StoreGPR: {
+          auto store_op = lunatic_cast<IRStoreGPR>(op);
+
+          if (reads_tainted_var || (store_op->reg.reg == GPR::PC && !store_op->value.IsConstant())) {
+            return false;
+          }
+          break;
+        }
+        case IROpcodeClass::StoreCPSR: {
+          if (reads_tainted_var) {
+            return false;
+          }
+          auto& value = lunatic_cast<IRStoreCPSR>(op)->value;
+
+          if (micro_block.condition == Condition::AL && value.IsVariable()) {
+            flags_written |= updated_flags[value.GetVar().id];
+          }
+          break;
+        }
+        default: {
+          // Anything else might have side effects or depend on the carry flag.
+          return false;
+        }
+      }
+
+      if (UpdatesHostFlags(op)) {
+        tainted_host_flags = reads_tainted_var;
+      }
+
+      if (taint_result) {
+        for (auto const& var : emitter.Vars()) {
+          if (op->Writes(*var)) {
+            tainted_vars.push_back(var.get());
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+} // namespace lunatic::frontend
+} // namespace lunatic
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include "basic_block.hpp"
+
+namespace lunatic {
+namespace frontend {
+
+/**
+ * Checks if a basic block is a polling loop, which branches to itself and only reads memory.
+ * Every iteration of such a loop must leave the guest state exactly like the previous iteration did,
+ * as long as the values read from memory do not change. Then running the loop until it is exited
+ * is equivalent to running it once and consuming all remaining cycles.
+ */
+bool IsIdleLoop(BasicBlock const& basic_block);
+
+} // namespace lunatic::frontend
+} // namespace lunatic
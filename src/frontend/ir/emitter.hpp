@@ -11,8 +11,8 @@
 #include <memory>
 #include <vector>
 
+#include "common/arena_allocator.hpp"
 #include "common/optional.hpp"
-#include "common/pool_allocator.hpp"
 #include "opcode.hpp"
 
 namespace lunatic {
@@ -20,7 +20,7 @@ namespace frontend {
 
 struct IREmitter {
   using OpcodePtr = std::unique_ptr<IROpcode>;
-  using InstructionList = std::list<OpcodePtr, StdPoolAlloc<OpcodePtr>>;
+  using InstructionList = std::list<OpcodePtr, StdArenaAlloc<OpcodePtr>>;
   using VariableList = std::vector<std::unique_ptr<IRVariable>>;
 
   IREmitter() = default;
@@ -34,6 +34,7 @@ struct IREmitter {
   IREmitter& operator=(IREmitter&& emitter) {
     std::swap(code, emitter.code);
     std::swap(variables, emitter.variables);
+    std::swap(guest_address, emitter.guest_address);
     return *this;
   }
 
@@ -42,6 +43,9 @@ struct IREmitter {
   auto Vars() const -> VariableList const& { return variables; }
   auto ToString() const -> std::string;
 
+  /// Set the address of the guest instruction, which subsequently emitted opcodes belong to.
+  void SetGuestAddress(u32 address) { guest_address = address; }
+
   auto CreateVar(
     IRDataType data_type,
     char const* label = nullptr
@@ -269,11 +273,15 @@ struct IREmitter {
 private:
   template<typename T, typename... Args>
   void Push(Args&&... args) {
-    code.push_back(std::make_unique<T>(args...));
+    auto op = std::make_unique<T>(args...);
+
+    op->guest_address = guest_address;
+    code.push_back(std::move(op));
   }
 
   InstructionList code;
   VariableList variables;
+  u32 guest_address = 0;
 };
 
 } // namespace lunatic::frontend
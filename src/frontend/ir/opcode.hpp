@@ -10,7 +10,7 @@
 #include <fmt/format.h>
 #include <stdexcept>
 
-#include "common/pool_allocator.hpp"
+#include "common/arena_allocator.hpp"
 #include "register.hpp"
 #include "value.hpp"
 
@@ -61,12 +61,14 @@ enum class IROpcodeClass {
 // TODO: Reads(), Writes() and ToString() should be const,
 // but due to the nature of this Optional<T> implementation this is not possible at the moment.
 
-struct IROpcode : PoolObject {
+struct IROpcode : ArenaObject {
   virtual ~IROpcode() = default;
 
   virtual auto GetClass() const -> IROpcodeClass = 0;
   virtual auto Reads (IRVariable const& var) -> bool = 0;
   virtual auto Writes(IRVariable const& var) -> bool = 0;
+  virtual auto GetReads() -> IRVariableList = 0;
+  virtual auto GetWrites() -> IRVariableList = 0;
   virtual void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -76,6 +78,9 @@ struct IROpcode : PoolObject {
     IRConstant const& constant
   ) {}
   virtual auto ToString() -> std::string = 0;
+
+  /// Address of the guest instruction, which this opcode was translated from.
+  u32 guest_address = 0;
 };
 
 template<IROpcodeClass _klass>
@@ -94,6 +99,14 @@ struct IRNoOp final : IROpcodeBase<IROpcodeClass::NOP> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -122,6 +135,14 @@ struct IRLoadGPR final : IROpcodeBase<IROpcodeClass::LoadGPR> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -158,6 +179,14 @@ struct IRStoreGPR final : IROpcodeBase<IROpcodeClass::StoreGPR> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {value};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -198,6 +227,14 @@ struct IRLoadSPSR final : IROpcodeBase<IROpcodeClass::LoadSPSR> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -231,6 +268,14 @@ struct IRStoreSPSR final : IROpcodeBase<IROpcodeClass::StoreSPSR> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {value};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -268,6 +313,14 @@ struct IRLoadCPSR final : IROpcodeBase<IROpcodeClass::LoadCPSR> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -293,6 +346,14 @@ struct IRStoreCPSR final : IROpcodeBase<IROpcodeClass::StoreCPSR> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {value};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -321,6 +382,14 @@ struct IRClearCarry final : IROpcodeBase<IROpcodeClass::ClearCarry> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -343,6 +412,14 @@ struct IRSetCarry final : IROpcodeBase<IROpcodeClass::SetCarry> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -387,6 +464,14 @@ struct IRUpdateFlags final : IROpcodeBase<IROpcodeClass::UpdateFlags> {
     return &result.Get() == &var;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {input};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -425,6 +510,14 @@ struct IRUpdateSticky final : IROpcodeBase<IROpcodeClass::UpdateSticky> {
     return &result.Get() == &var;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {input};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -469,6 +562,14 @@ struct IRShifterBase : IROpcodeBase<_klass> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {operand, amount};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -571,6 +672,14 @@ struct IRBinaryOpBase : IROpcodeBase<_klass> {
     return result.HasValue() && (&result.Unwrap() == &var);
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {lhs, rhs};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -754,6 +863,14 @@ struct IRMov final : IROpcodeBase<IROpcodeClass::MOV> {
     return &result.Get() == &var;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {source};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -801,6 +918,14 @@ struct IRMvn final : IROpcodeBase<IROpcodeClass::MVN> {
     return &result.Get() == &var;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {source};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -855,6 +980,14 @@ struct IRMultiply final : IROpcodeBase<IROpcodeClass::MUL> {
           (result_hi.HasValue() && (&result_hi.Unwrap() == &var));
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {lhs, rhs};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result_lo, result_hi};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -928,6 +1061,14 @@ struct IRAdd64 final : IROpcodeBase<IROpcodeClass::ADD64> {
     return &var == &result_hi.Get() || &var == &result_lo.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {lhs_hi, lhs_lo, rhs_hi, rhs_lo};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result_hi, result_lo};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -989,6 +1130,14 @@ struct IRMemoryRead final : IROpcodeBase<IROpcodeClass::MemoryRead> {
     return &result.Get() == &var;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {address};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1043,6 +1192,14 @@ struct IRMemoryWrite final : IROpcodeBase<IROpcodeClass::MemoryWrite> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {address, source};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1096,6 +1253,14 @@ struct IRFlush final : IROpcodeBase<IROpcodeClass::Flush> {
     return &var == &address_out.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {address_in, cpsr_in};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {address_out};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1140,6 +1305,14 @@ struct IRFlushExchange final : IROpcodeBase<IROpcodeClass::FlushExchange> {
     return &var == &address_out.Get() || &var == &cpsr_out.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {address_in, cpsr_in};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {address_out, cpsr_out};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1178,6 +1351,14 @@ struct IRCountLeadingZeros final : IROpcodeBase<IROpcodeClass::CLZ> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {operand};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1214,6 +1395,14 @@ struct IRSaturatingAdd final : IROpcodeBase<IROpcodeClass::QADD> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {lhs, rhs};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1252,6 +1441,14 @@ struct IRSaturatingSub final : IROpcodeBase<IROpcodeClass::QSUB> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {lhs, rhs};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1302,6 +1499,14 @@ struct IRReadCoprocessorRegister final : IROpcodeBase<IROpcodeClass::MRC> {
     return &var == &result.Get();
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {result};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
@@ -1353,6 +1558,14 @@ struct IRWriteCoprocessorRegister final : IROpcodeBase<IROpcodeClass::MCR> {
     return false;
   }
 
+  auto GetReads() -> IRVariableList override {
+    return {value};
+  }
+
+  auto GetWrites() -> IRVariableList override {
+    return {};
+  }
+
   void Repoint(
     IRVariable const& var_old,
     IRVariable const& var_new
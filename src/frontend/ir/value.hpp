@@ -7,12 +7,13 @@
 
 #pragma once
 
+#include <array>
 #include <fmt/format.h>
 #include <lunatic/integer.hpp>
 #include <stdexcept>
 
+#include "common/arena_allocator.hpp"
 #include "common/optional.hpp"
-#include "common/pool_allocator.hpp"
 
 namespace lunatic {
 namespace frontend {
@@ -23,7 +24,7 @@ enum class IRDataType {
 };
 
 /// Represents an immutable variable
-struct IRVariable : PoolObject {
+struct IRVariable : ArenaObject {
   IRVariable(IRVariable const& other) = delete;
 
   /// ID that is unique inside the IREmitter instance.
@@ -146,6 +147,48 @@ private:
   IRVariable const* p_var;
 };
 
+/// Fixed-size list of the variables, which an opcode reads or writes.
+struct IRVariableList {
+  IRVariableList() = default;
+
+  template<typename... Args>
+  IRVariableList(Args const&... args) {
+    // Each argument adds at most one variable, so this bounds the number of variables.
+    static_assert(sizeof...(Args) <= kCapacity, "IRVariableList: too many variables");
+
+    (Add(args), ...);
+  }
+
+  auto begin() const { return vars.begin(); }
+  auto end() const { return vars.begin() + size; }
+
+private:
+  void Add(IRVariable const& var) {
+    vars[size++] = &var;
+  }
+
+  void Add(IRVarRef const& var) {
+    Add(var.Get());
+  }
+
+  void Add(IRAnyRef const& value) {
+    if (value.IsVariable()) {
+      Add(value.GetVar());
+    }
+  }
+
+  void Add(Optional<IRVariable const&> var) {
+    if (var.HasValue()) {
+      Add(var.Unwrap());
+    }
+  }
+
+  static constexpr size_t kCapacity = 4;
+
+  std::array<IRVariable const*, kCapacity> vars;
+  size_t size = 0;
+};
+
 } // namespace lunatic::frontend 
 } // namespace lunatic
 
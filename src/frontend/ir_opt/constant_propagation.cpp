@@ -12,11 +12,13 @@ namespace lunatic {
 namespace frontend {
 
 void IRConstantPropagationPass::Run(IREmitter& emitter) {
-  this->emitter = &emitter;
+  BuildUseLists(emitter);
   var_to_const.clear();
   var_to_const.resize(emitter.Vars().size());
 
   for (auto& op : emitter.Code()) {
+    auto guest_address = op->guest_address;
+
     switch (op->GetClass()) {
       case IROpcodeClass::MOV: DoMOV(op); break;
       case IROpcodeClass::LSL: DoLSL(op); break;
@@ -31,18 +33,15 @@ void IRConstantPropagationPass::Run(IREmitter& emitter) {
       case IROpcodeClass::ORR: DoBinaryOp<IRBitwiseORR>(op); break;
       case IROpcodeClass::MUL: DoMUL(op); break;
     }
+
+    // The opcode may have been replaced.
+    op->guest_address = guest_address;
   }
 }
 
 void IRConstantPropagationPass::Propagate(IRVariable const& var, IRConstant const& constant) {
   var_to_const[var.id] = constant;
-
-  // TODO: start at the opcode where the variable is first written.
-  for (auto& op : emitter->Code()) {
-    if (op->Reads(var)) {
-      op->PropagateConstant(var, constant);
-    }
-  }
+  PropagateConstant(var, constant);
 };
 
 auto IRConstantPropagationPass::GetKnownConstant(IRVarRef const& var) -> Optional<IRConstant>& {
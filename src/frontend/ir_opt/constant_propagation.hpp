@@ -39,7 +39,6 @@ private:
     return std::make_unique<IRNoOp>();
   };
 
-  IREmitter* emitter;
   std::vector<Optional<IRConstant>> var_to_const{};
 };
 
@@ -25,8 +25,13 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
   IRAnyRef current_gpr_value[512] {};
   IRAnyRef current_cpsr_value;
 
+  BuildUseLists(emitter);
+
   auto Move = [&](IRVariable const& dst, IRAnyRef src) {
-    code.insert(it, std::make_unique<IRMov>(dst, src, false));
+    auto op = std::make_unique<IRMov>(dst, src, false);
+
+    op->guest_address = (*it)->guest_address;
+    AddUses(code.insert(it, std::move(op)));
   };
 
   while (it != end) {
@@ -48,7 +53,7 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
           it = code.erase(it);
 
           // TODO: if var_src is constant attempt updating IRAnyRefs.
-          if (var_src.IsConstant() || !Repoint(var_dst, var_src.GetVar(), it, end)) {
+          if (var_src.IsConstant() || !Repoint(var_dst, var_src.GetVar())) {
             Move(var_dst, var_src);
           }
           continue;
@@ -70,7 +75,7 @@ void IRContextLoadStoreElisionPass::RemoveLoads(IREmitter& emitter) {
           it = code.erase(it);
 
           // TODO: if var_src is constant attempt updating IRAnyRefs.
-          if (var_src.IsConstant() || !Repoint(var_dst, var_src.GetVar(), it, end)) {
+          if (var_src.IsConstant() || !Repoint(var_dst, var_src.GetVar())) {
             Move(var_dst, var_src);
           }
           continue;
@@ -102,6 +107,7 @@ void IRContextLoadStoreElisionPass::RemoveStores(IREmitter& emitter) {
         auto gpr_id = op->reg.ID();
 
         if (gpr_already_stored[gpr_id]) {
+          RemoveUses(std::next(it).base());
           it = std::reverse_iterator{code.erase(std::next(it).base())};
           end = code.rend();
           continue;
@@ -112,6 +118,7 @@ void IRContextLoadStoreElisionPass::RemoveStores(IREmitter& emitter) {
       }
       case IROpcodeClass::StoreCPSR: {
         if (cpsr_already_stored) {
+          RemoveUses(std::next(it).base());
           it = std::reverse_iterator{code.erase(std::next(it).base())};
           end = code.rend();
           continue;
@@ -13,6 +13,7 @@ namespace frontend {
 void IRDeadCodeElisionPass::Run(IREmitter& emitter) {
 	auto& code = emitter.Code();
   this->emitter = &emitter;
+  BuildUseLists(emitter);
   it = code.begin();
   end = code.end();
 
@@ -35,6 +36,7 @@ void IRDeadCodeElisionPass::Run(IREmitter& emitter) {
     }
 
     if (dead) {
+      RemoveUses(it);
       it = code.erase(it);
     } else {
       ++it;
@@ -43,14 +45,14 @@ void IRDeadCodeElisionPass::Run(IREmitter& emitter) {
 }
 
 bool IRDeadCodeElisionPass::CheckMOV(IRMov* op) {
-  if (IsValueUnused(op->result.Get()) && !op->update_host_flags) {
+  if (IsUnused(op->result.Get()) && !op->update_host_flags) {
     return true;
   }
 
   // MOV var_a, var_b: var_a is a redundant variable.
   if (op->source.IsVariable() &&
       !op->update_host_flags &&
-    Repoint(op->result.Get(), op->source.GetVar(), it, end)
+    Repoint(op->result.Get(), op->source.GetVar())
   ) {
     return true;
   }
@@ -60,7 +62,7 @@ bool IRDeadCodeElisionPass::CheckMOV(IRMov* op) {
 
 template<class OpcodeType>
 bool IRDeadCodeElisionPass::CheckShifterOp(OpcodeType* op) {
-  if (IsValueUnused(op->result.Get()) && !op->update_host_flags) {
+  if (IsUnused(op->result.Get()) && !op->update_host_flags) {
     return true;
   }
 
@@ -68,7 +70,7 @@ bool IRDeadCodeElisionPass::CheckShifterOp(OpcodeType* op) {
   if constexpr(OpcodeType::klass == IROpcodeClass::LSL) {
     if (op->amount.IsConstant() &&
         op->amount.GetConst().value == 0 &&
-        Repoint(op->result.Get(), op->operand.Get(), it, end)
+        Repoint(op->result.Get(), op->operand.Get())
     ) {
       return true;
     }
@@ -79,7 +81,7 @@ bool IRDeadCodeElisionPass::CheckShifterOp(OpcodeType* op) {
 
 template<class OpcodeType>
 bool IRDeadCodeElisionPass::CheckBinaryOp(OpcodeType* op) {
-  if ((!op->result.HasValue() ||IsValueUnused(op->result.Unwrap())) && !op->update_host_flags) {
+  if ((!op->result.HasValue() ||IsUnused(op->result.Unwrap())) && !op->update_host_flags) {
     return true;
   }
 
@@ -89,7 +91,7 @@ bool IRDeadCodeElisionPass::CheckBinaryOp(OpcodeType* op) {
         op->rhs.IsConstant() &&
         op->rhs.GetConst().value == 0 &&
         !op->update_host_flags &&
-        Repoint(op->result.Unwrap(), op->lhs.Get(), it, end)
+        Repoint(op->result.Unwrap(), op->lhs.Get())
     ) {
       return true;
     }
@@ -99,8 +101,8 @@ bool IRDeadCodeElisionPass::CheckBinaryOp(OpcodeType* op) {
 }
 
 bool IRDeadCodeElisionPass::CheckMUL(IRMultiply* op) {
-  if (IsValueUnused(op->result_lo.Get()) &&
-      (!op->result_hi.HasValue() || IsValueUnused(op->result_hi.Unwrap())) &&
+  if (IsUnused(op->result_lo.Get()) &&
+      (!op->result_hi.HasValue() || IsUnused(op->result_hi.Unwrap())) &&
       !op->update_host_flags
   ) {
     return true;
@@ -109,19 +111,5 @@ bool IRDeadCodeElisionPass::CheckMUL(IRMultiply* op) {
   return false;
 }
 
-bool IRDeadCodeElisionPass::IsValueUnused(IRVariable const& var) {
-  auto local_it = it;
-
-  ++local_it;
-
-  while (local_it != end) {
-    if (local_it->get()->Reads(var))
-      return false;
-    ++local_it;
-  }
-
-  return true;
-}
-
 } // namespace lunatic::frontend
 } // namespace lunatic
\ No newline at end of file
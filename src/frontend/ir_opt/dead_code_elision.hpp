@@ -26,8 +26,6 @@ private:
 
   bool CheckMUL(IRMultiply* op);
 
-  bool IsValueUnused(IRVariable const& var);
-
   IREmitter* emitter;
   IREmitter::InstructionList::iterator it;
   IREmitter::InstructionList::iterator end;
@@ -5,7 +5,7 @@
  * found in the LICENSE file.
  */
 
-
+#include "frontend/flag_liveness.hpp"
 #include "frontend/ir_opt/dead_flag_elision.hpp"
 
 namespace lunatic {
@@ -13,6 +13,7 @@ namespace frontend {
 
 void IRDeadFlagElisionPass::Run(IREmitter& emitter) {
   RemoveRedundantUpdateFlagsOpcodes(emitter);
+  RemoveRedundantStoreCPSROpcodes(emitter);
   DisableRedundantFlagCalculations(emitter);
 }
 
@@ -32,8 +33,37 @@ void IRDeadFlagElisionPass::RemoveRedundantUpdateFlagsOpcodes(IREmitter& emitter
 
   Optional<IRVariable const&> current_cpsr_in{};
 
+  // Flags which are dead on exit do not need to be written by the last CPSR store.
+  bool before_last_cpsr_store = flags_dead_on_exit != 0;
+
+  BuildUseLists(emitter);
+
   while (it != end) {
     switch (it->get()->GetClass()) {
+      case IROpcodeClass::LoadCPSR: {
+        before_last_cpsr_store = false;
+        break;
+      }
+      case IROpcodeClass::StoreCPSR: {
+        auto op = lunatic_cast<IRStoreCPSR>(it->get());
+
+        if (before_last_cpsr_store && op->value.IsVariable() && GetNumberOfUses(op->value.GetVar()) == 1) {
+          unused_n = flags_dead_on_exit & kFlagN;
+          unused_z = flags_dead_on_exit & kFlagZ;
+          unused_c = flags_dead_on_exit & kFlagC;
+          unused_v = flags_dead_on_exit & kFlagV;
+          current_cpsr_in = op->value.GetVar();
+        } else if (current_cpsr_in.HasValue() && op->Reads(current_cpsr_in.Unwrap())) {
+          unused_n = false;
+          unused_z = false;
+          unused_c = false;
+          unused_v = false;
+          current_cpsr_in = {};
+        }
+
+        before_last_cpsr_store = false;
+        break;
+      }
       case IROpcodeClass::UpdateFlags: {
         auto op = lunatic_cast<IRUpdateFlags>(it->get());
 
@@ -45,9 +75,9 @@ void IRDeadFlagElisionPass::RemoveRedundantUpdateFlagsOpcodes(IREmitter& emitter
 
           // Elide update.nzcv opcodes that now don't update any flag.
           if (!op->flag_n && !op->flag_z && !op->flag_c && !op->flag_v) {
-            // TODO: do not use begin()?
-            if (Repoint(op->result.Get(), op->input.Get(), code.begin(), code.end())) {
+            if (Repoint(op->result.Get(), op->input.Get())) {
               current_cpsr_in = op->input.Get();
+              RemoveUses(std::next(it).base());
               it = std::reverse_iterator{code.erase(std::next(it).base())};
               end = code.rend();
               continue;
@@ -61,7 +91,7 @@ void IRDeadFlagElisionPass::RemoveRedundantUpdateFlagsOpcodes(IREmitter& emitter
         if (op->flag_v) unused_v = true;
 
         current_cpsr_in = op->input.Get();
-
+        before_last_cpsr_store = false;
         break;
       }
       default: {
@@ -84,6 +114,48 @@ void IRDeadFlagElisionPass::RemoveRedundantUpdateFlagsOpcodes(IREmitter& emitter
   }
 }
 
+void IRDeadFlagElisionPass::RemoveRedundantStoreCPSROpcodes(IREmitter& emitter) {
+  auto& code = emitter.Code();
+  auto load = code.end();
+
+  for (auto it = code.begin(); it != code.end();) {
+    switch (it->get()->GetClass()) {
+      case IROpcodeClass::LoadCPSR: {
+        load = it;
+        break;
+      }
+      case IROpcodeClass::StoreCPSR: {
+        auto op = lunatic_cast<IRStoreCPSR>(it->get());
+
+        // Storing the value which was loaded after the last store leaves the CPSR unchanged.
+        if (load != code.end() && op->value.IsVariable()) {
+          auto& loaded_var = lunatic_cast<IRLoadCPSR>(load->get())->result.Get();
+
+          if (&op->value.GetVar() == &loaded_var) {
+            RemoveUses(it);
+            it = code.erase(it);
+
+            if (IsUnused(loaded_var)) {
+              code.erase(load);
+            }
+
+            load = code.end();
+            continue;
+          }
+        }
+
+        load = code.end();
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+
+    ++it;
+  }
+}
+
 void IRDeadFlagElisionPass::DisableRedundantFlagCalculations(IREmitter& emitter) {
   auto& code = emitter.Code();
   auto it = code.rbegin();
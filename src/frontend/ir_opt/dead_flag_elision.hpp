@@ -15,9 +15,20 @@ namespace frontend {
 struct IRDeadFlagElisionPass final : IRPass {
   void Run(IREmitter& emitter) override;
 
+  /**
+   * Set the NZCV flags (see FlagMask), which are overwritten after the next micro block before they are read.
+   * These flags do not need to be stored to the CPSR at the end of the micro block.
+   */
+  void SetFlagsDeadOnExit(u8 flags_dead_on_exit) {
+    this->flags_dead_on_exit = flags_dead_on_exit;
+  }
+
 private:
   void RemoveRedundantUpdateFlagsOpcodes(IREmitter& emitter);
+  void RemoveRedundantStoreCPSROpcodes(IREmitter& emitter);
   void DisableRedundantFlagCalculations(IREmitter& emitter);
+
+  u8 flags_dead_on_exit = 0;
 };
 
 } // namespace lunatic::frontend
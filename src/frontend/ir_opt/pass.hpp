@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "frontend/ir/emitter.hpp"
 
 namespace lunatic {
@@ -20,22 +23,89 @@ struct IRPass {
 protected:
   using InstructionList = IREmitter::InstructionList;
 
+  /**
+   * Map each variable to the opcodes which read it, so that passes do not
+   * need to rescan the whole program to find the readers of a variable.
+   * Passes which insert or erase opcodes must update the use lists via AddUses() and RemoveUses().
+   */
+  void BuildUseLists(IREmitter& emitter) {
+    auto& code = emitter.Code();
+
+    // Clear the lists rather than the outer vector to keep their memory around.
+    for (auto& uses : use_lists) {
+      uses.clear();
+    }
+    use_lists.resize(emitter.Vars().size());
+
+    for (auto it = code.begin(); it != code.end(); ++it) {
+      AddUses(it);
+    }
+  }
+
+  void AddUses(InstructionList::iterator it) {
+    for (auto var : (*it)->GetReads()) {
+      use_lists[var->id].push_back(it);
+    }
+  }
+
+  void RemoveUses(InstructionList::iterator it) {
+    for (auto var : (*it)->GetReads()) {
+      auto& uses = use_lists[var->id];
+
+      uses.erase(std::remove(uses.begin(), uses.end(), it), uses.end());
+    }
+  }
+
+  bool IsUnused(IRVariable const& var) const {
+    return use_lists[var.id].empty();
+  }
+
+  auto GetNumberOfUses(IRVariable const& var) const -> size_t {
+    return use_lists[var.id].size();
+  }
+
   bool Repoint(
     IRVariable const& var_old,
-    IRVariable const& var_new,
-    InstructionList::const_iterator begin,
-    InstructionList::const_iterator end
+    IRVariable const& var_new
   ) {
     if (var_old.data_type != var_new.data_type) {
       return false;
     }
-    
-    for (auto it = begin; it != end; ++it) {
-      (*it)->Repoint(var_old, var_new); 
+
+    if (&var_old == &var_new) {
+      return true;
+    }
+
+    auto& uses_old = use_lists[var_old.id];
+    auto& uses_new = use_lists[var_new.id];
+
+    for (auto it : uses_old) {
+      (*it)->Repoint(var_old, var_new);
+      uses_new.push_back(it);
     }
 
+    uses_old.clear();
     return true;
-  }  
+  }
+
+  void PropagateConstant(
+    IRVariable const& var,
+    IRConstant const& constant
+  ) {
+    auto& uses = use_lists[var.id];
+
+    for (auto it : uses) {
+      (*it)->PropagateConstant(var, constant);
+    }
+
+    // Some operands cannot hold a constant, those keep reading the variable.
+    uses.erase(std::remove_if(uses.begin(), uses.end(), [&](auto it) {
+      return !(*it)->Reads(var);
+    }), uses.end());
+  }
+
+private:
+  std::vector<std::vector<InstructionList::iterator>> use_lists;
 };
 
 } // namespace lunatic::frontend
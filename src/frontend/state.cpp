@@ -5,6 +5,7 @@
  * found in the LICENSE file.
  */
 
+#include <cstddef>
 #include <stdexcept>
 
 #include "state.hpp"
@@ -13,7 +14,6 @@ namespace lunatic {
 namespace frontend {
 
 State::State() {
-  InitializeLookupTable();
   Reset();
 }
 
@@ -28,81 +28,84 @@ void State::Reset() {
 }
 
 auto State::GetPointerToGPR(Mode mode, GPR reg) -> u32* {
-  auto id = static_cast<int>(reg);
-  if (id > 15) {
-    throw std::runtime_error("GetPointerToGPR: requirement not met: 'id' must be <= 15.");
-  }
-  auto pointer = table[static_cast<int>(mode)].gpr[id];
-  if (pointer == nullptr) {
-    throw std::runtime_error(
-      "GetPointerToGPR: requirement not met: 'mode' must be valid ARM processor mode.");
-  }
-  return pointer;
+  return reinterpret_cast<u32*>(uintptr(this) + GetOffsetToGPR(mode, reg));
 }
 
 auto State::GetPointerToSPSR(Mode mode) -> StatusRegister* {
-  auto pointer = table[static_cast<int>(mode)].spsr;
-  if (pointer == nullptr) {
-    throw std::runtime_error(
-      "GetPointerToSPSR: requirement not met: 'mode' must be valid ARM processor mode "
-      "and may not be System or User mode.");
-  }
-  return pointer;
+  return reinterpret_cast<StatusRegister*>(uintptr(this) + GetOffsetToSPSR(mode));
 }
 
 auto State::GetPointerToCPSR() -> StatusRegister* {
   return &common.cpsr;
 }
 
+/* The offsets do not depend on the instance, so the backend may use them without a State object.
+ * r0 - r7 and r15 are shared by all modes, r8 - r12 are banked for FIQ mode only
+ * and r13 - r14 are banked for every mode except System mode, which shares them with User mode.
+ */
 auto State::GetOffsetToSPSR(Mode mode) -> uintptr {
-  return uintptr(GetPointerToSPSR(mode)) - uintptr(this);
+  switch (mode) {
+    case Mode::FIQ: return offsetof(State, fiq.spsr);
+    case Mode::IRQ: return offsetof(State, irq.spsr);
+    case Mode::Supervisor: return offsetof(State, svc.spsr);
+    case Mode::Abort: return offsetof(State, abt.spsr);
+    case Mode::Undefined: return offsetof(State, und.spsr);
+    default: break;
+  }
+
+  throw std::runtime_error(
+    "GetOffsetToSPSR: requirement not met: 'mode' must be valid ARM processor mode "
+    "and may not be System or User mode.");
 }
 
 auto State::GetOffsetToCPSR() -> uintptr {
-  return uintptr(GetPointerToCPSR()) - uintptr(this);
+  return offsetof(State, common.cpsr);
 }
 
 auto State::GetOffsetToGPR(Mode mode, GPR reg) -> uintptr {
-  return uintptr(GetPointerToGPR(mode, reg)) - uintptr(this);
-}
+  auto id = static_cast<int>(reg);
+  if (id > 15) {
+    throw std::runtime_error("GetOffsetToGPR: requirement not met: 'id' must be <= 15.");
+  }
 
-void State::InitializeLookupTable() {
-  Mode modes[] = {
-    Mode::User,
-    Mode::FIQ,
-    Mode::IRQ,
-    Mode::Supervisor,
-    Mode::Abort,
-    Mode::Undefined,
-    Mode::System
-  };
-
-  for (auto mode : modes) {
-    for (int i = 0; i <= 7; i++)
-      table[static_cast<int>(mode)].gpr[i] = &common.reg[i];
-    auto source = mode == Mode::FIQ ? fiq.reg : sys.reg;
-    for (int i = 8; i <= 12; i++)
-      table[static_cast<int>(mode)].gpr[i] = &source[i - 8];
-    table[static_cast<int>(mode)].gpr[15] = &common.r15;
+  auto banked = uintptr{};
+
+  switch (mode) {
+    case Mode::User:
+    case Mode::System: banked = offsetof(State, sys.reg[5]); break;
+    case Mode::FIQ: banked = offsetof(State, fiq.reg[5]); break;
+    case Mode::IRQ: banked = offsetof(State, irq.reg); break;
+    case Mode::Supervisor: banked = offsetof(State, svc.reg); break;
+    case Mode::Abort: banked = offsetof(State, abt.reg); break;
+    case Mode::Undefined: banked = offsetof(State, und.reg); break;
+    default:
+      throw std::runtime_error(
+        "GetOffsetToGPR: requirement not met: 'mode' must be valid ARM processor mode.");
   }
 
-  for (int i = 0; i < 2; i++) {
-    table[static_cast<int>(Mode::User)].gpr[13 + i] = &sys.reg[5 + i];
-    table[static_cast<int>(Mode::FIQ)].gpr[13 + i] = &fiq.reg[5 + i];
-    table[static_cast<int>(Mode::IRQ)].gpr[13 + i] = &irq.reg[i];
-    table[static_cast<int>(Mode::Supervisor)].gpr[13 + i] = &svc.reg[i];
-    table[static_cast<int>(Mode::Abort)].gpr[13 + i] = &abt.reg[i];
-    table[static_cast<int>(Mode::Undefined)].gpr[13 + i] = &und.reg[i];
-    table[static_cast<int>(Mode::System)].gpr[13 + i] = &sys.reg[5 + i];
+  if (id <= 7) {
+    return offsetof(State, common.reg) + id * sizeof(u32);
+  }
+  if (id <= 12) {
+    auto source = mode == Mode::FIQ ? offsetof(State, fiq.reg) : offsetof(State, sys.reg);
+    return source + (id - 8) * sizeof(u32);
   }
+  if (id <= 14) {
+    return banked + (id - 13) * sizeof(u32);
+  }
+  return offsetof(State, common.r15);
+}
+
+auto State::GetOffsetToIRQLine() -> uintptr {
+  return offsetof(State, signals.irq_line);
+}
+
+auto State::GetOffsetToRequests() -> uintptr {
+  return offsetof(State, signals.requests);
+}
 
-  table[static_cast<int>(Mode::User)].spsr = nullptr;
-  table[static_cast<int>(Mode::FIQ)].spsr = &fiq.spsr;
-  table[static_cast<int>(Mode::IRQ)].spsr = &irq.spsr;
-  table[static_cast<int>(Mode::Supervisor)].spsr = &svc.spsr;
-  table[static_cast<int>(Mode::Abort)].spsr = &abt.spsr;
-  table[static_cast<int>(Mode::Undefined)].spsr = &und.spsr;
-  table[static_cast<int>(Mode::System)].spsr = nullptr;
+auto State::GetOffsetToIdleLoopFlag() -> uintptr {
+  return offsetof(State, signals.idle_loop);
 }
 
 } // namespace lunatic::frontend
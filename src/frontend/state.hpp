@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <lunatic/cpu.hpp>
 #include <string>
 
@@ -26,6 +27,18 @@ struct State {
   /// \returns reference to the current program status register (cpsr).
   auto GetCPSR() -> StatusRegister& { return common.cpsr; }
 
+  /// \returns reference to the IRQ line.
+  auto GetIRQLine() -> bool& { return signals.irq_line; }
+
+  /// \returns reference to the word holding requests posted by other threads.
+  auto GetRequests() -> std::atomic<u32>& { return signals.requests; }
+
+  /// \returns reference to the flag which is set when an idle loop was skipped.
+  auto GetIdleLoopFlag() -> bool& { return signals.idle_loop; }
+
+  /// \returns whether an idle loop was skipped.
+  auto GetIdleLoopFlag() const -> bool { return signals.idle_loop; }
+
   /// \returns for a given processor mode the pointer to a general-purpose register.
   auto GetPointerToGPR(Mode mode, GPR reg) -> u32*;
 
@@ -36,17 +49,24 @@ struct State {
   auto GetPointerToCPSR() -> StatusRegister*;
 
   /// \returns for a given processor mode the offset to the saved program status register (spsr).
-  auto GetOffsetToSPSR(Mode mode) -> uintptr;
+  static auto GetOffsetToSPSR(Mode mode) -> uintptr;
 
   /// \returns the offset to the current program status register (cpsr).
-  auto GetOffsetToCPSR() -> uintptr;
+  static auto GetOffsetToCPSR() -> uintptr;
 
   /// \returns for a given processor mode the offset of a general-purpose register.
-  auto GetOffsetToGPR(Mode mode, GPR reg) -> uintptr;
+  static auto GetOffsetToGPR(Mode mode, GPR reg) -> uintptr;
 
-private:
-  void InitializeLookupTable();
+  /// \returns the offset to the IRQ line.
+  static auto GetOffsetToIRQLine() -> uintptr;
 
+  /// \returns the offset to the request word.
+  static auto GetOffsetToRequests() -> uintptr;
+
+  /// \returns the offset to the idle loop flag.
+  static auto GetOffsetToIdleLoopFlag() -> uintptr;
+
+private:
   /// Common registers r0 - r7, r15 and cpsr.
   /// These registers are visible in all ARM processor modes.
   struct {
@@ -69,11 +89,13 @@ private:
     StatusRegister spsr = {};
   } irq, svc, abt, und;
 
-  /// Per ARM processor mode address/pointer lookup table for GPRs and SPSRs.
-  struct LookupTable {
-    u32* gpr[16] {nullptr};
-    StatusRegister* spsr {nullptr};
-  } table[0x20] = {};
+  /// Signals which are polled by compiled code at basic block boundaries.
+  /// These are not affected by Reset().
+  struct {
+    bool irq_line = false;
+    std::atomic<u32> requests{0};
+    bool idle_loop = false;
+  } signals;
 };
 
 } // namespace lunatic::frontend
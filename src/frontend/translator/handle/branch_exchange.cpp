@@ -21,6 +21,7 @@ auto Translator::Handle(ARMBranchExchange const& opcode) -> Status {
       link_address |= 1;
     }
     emitter->StoreGPR(IRGuestReg{GPR::LR, mode}, IRConstant{link_address});
+    AddReturnKey(code_address + opcode_size);
   }
 
   EmitFlushExchange(address);
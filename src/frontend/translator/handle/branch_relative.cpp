@@ -20,6 +20,7 @@ auto Translator::Handle(ARMBranchRelative const& opcode) -> Status {
       link_address |= 1;
     }
     emitter->StoreGPR(IRGuestReg{GPR::LR, mode}, IRConstant{link_address});
+    AddReturnKey(code_address + sizeof(u32));
   }
 
   if (opcode.exchange) {
@@ -49,6 +50,12 @@ auto Translator::Handle(ARMBranchRelative const& opcode) -> Status {
     basic_block->branch_target.key = {};
     return Status::Continue;
   } else {
+    basic_block->fallthrough_target.key = BasicBlock::Key{
+      code_address + opcode_size * 3,
+      mode,
+      thumb_mode
+    };
+
     if (opcode.exchange) {
       thumb_mode = !thumb_mode;
     }
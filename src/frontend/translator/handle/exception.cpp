@@ -43,6 +43,7 @@ auto Translator::Handle(ARMException const& opcode) -> Status {
 
   // Save next PC in LR
   emitter->StoreGPR(IRGuestReg{GPR::LR, new_mode}, IRConstant{code_address + opcode_size});
+  AddReturnKey(code_address + opcode_size);
 
   // Set PC to the exception vector.
   emitter->StoreGPR(IRGuestReg{GPR::PC, new_mode}, IRConstant{branch_address});
@@ -53,6 +54,11 @@ auto Translator::Handle(ARMException const& opcode) -> Status {
     basic_block->branch_target.key = {};
     return Status::Continue;
   } else {
+    basic_block->fallthrough_target.key = BasicBlock::Key{
+      code_address + opcode_size * 3,
+      mode,
+      thumb_mode
+    };
     basic_block->branch_target.key = BasicBlock::Key{
       branch_address,
       new_mode,
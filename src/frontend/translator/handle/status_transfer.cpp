@@ -46,11 +46,67 @@ auto Translator::Handle(ARMMoveStatusRegister const& opcode) -> Status {
   if (opcode.spsr) {
     emitter->StoreSPSR(psr_result, mode);
     return Status::Continue;
-  } else {
-    // TODO: if only the flags change then we should only break the micro block.
-    emitter->StoreCPSR(psr_result);
+  }
+
+  emitter->StoreCPSR(psr_result);
+
+  // The host carry flag is only reloaded from the CPSR when the dispatcher enters a basic block.
+  if (opcode.fsxc & 8) {
+    return Status::BreakBasicBlock;
+  }
+
+  // Mode, thumb bit and IRQ mask are unchanged.
+  if (~opcode.fsxc & 1) {
+    return Status::Continue;
+  }
+
+  if (!opcode.immediate) {
     return Status::BreakBasicBlock;
   }
+
+  auto new_mode = static_cast<Mode>(opcode.imm & 0x1F);
+  bool new_thumb_mode = opcode.imm & 0x20;
+  bool irq_enabled = (opcode.imm & 0x80) == 0;
+
+  switch (new_mode) {
+    case Mode::User:
+    case Mode::FIQ:
+    case Mode::IRQ:
+    case Mode::Supervisor:
+    case Mode::Abort:
+    case Mode::Undefined:
+    case Mode::System:
+      break;
+    default:
+      return Status::BreakBasicBlock;
+  }
+
+  if (new_thumb_mode != thumb_mode) {
+    return Status::BreakBasicBlock;
+  }
+
+  // A conditional mode switch leaves the mode of the following instructions unknown.
+  if (new_mode != mode && opcode.condition != Condition::AL) {
+    return Status::BreakBasicBlock;
+  }
+
+  /* A pending IRQ must be taken before the next instruction, once IRQs are unmasked.
+   * End the basic block there, but let it link to the next basic block if no IRQ is pending.
+   */
+  if (irq_enabled) {
+    if (opcode.condition == Condition::AL) {
+      basic_block->branch_target.key = BasicBlock::Key{
+        code_address + opcode_size * 3,
+        new_mode,
+        thumb_mode
+      };
+      basic_block->branch_target.condition = Condition::AL;
+    }
+    return Status::BreakBasicBlock;
+  }
+
+  mode = new_mode;
+  return Status::Continue;
 }
 
 auto Translator::Handle(ARMMoveRegisterStatus const& opcode) -> Status {
@@ -19,6 +19,7 @@ auto Translator::Handle(ThumbBranchLinkSuffix const& opcode) -> Status {
   emitter->LoadGPR(IRGuestReg{GPR::LR, mode}, lr);
   emitter->ADD(pc1, lr, IRConstant{opcode.offset}, false);
   emitter->StoreGPR(IRGuestReg{GPR::LR, mode}, IRConstant{u32((code_address + sizeof(u16)) | 1)});
+  AddReturnKey(code_address + sizeof(u16));
 
   if (armv5te && opcode.exchange) {
     auto& cpsr_in  = emitter->CreateVar(IRDataType::UInt32, "cpsr_in");
@@ -37,6 +37,24 @@ void Translator::Translate(BasicBlock& basic_block) {
     basic_block.branch_target.key = {next_pc, mode, thumb_mode};
     basic_block.branch_target.condition = Condition::AL;
   }
+
+  if (status == Status::Continue) {
+    basic_block.next_key = basic_block.branch_target.key;
+  }
+}
+
+void Translator::AddCodeRange(u32 size) {
+  auto& code_ranges = basic_block->code_ranges;
+
+  if (!code_ranges.empty() && code_ranges.back().address + code_ranges.back().size == code_address) {
+    code_ranges.back().size += size;
+  } else {
+    code_ranges.push_back({code_address, size});
+  }
+}
+
+void Translator::AddReturnKey(u32 return_address) {
+  basic_block->return_keys.push_back(BasicBlock::Key{return_address + 2 * opcode_size, mode, thumb_mode});
 }
 
 Status Translator::TranslateARM(BasicBlock& basic_block) {
@@ -72,6 +90,11 @@ Status Translator::TranslateARM(BasicBlock& basic_block) {
       break_micro_block(condition);
     }
 
+    // The handler may switch the instruction set, but the next instruction is only reached if it does not branch.
+    basic_block.next_key = {code_address + 3 * opcode_size, mode, thumb_mode};
+
+    AddCodeRange(sizeof(u32));
+    emitter->SetGuestAddress(code_address);
     status = decode_arm(instruction, *this);
 
     if (status == Status::Unimplemented) {
@@ -134,6 +157,11 @@ Status Translator::TranslateThumb(BasicBlock& basic_block) {
       }
     }
 
+    basic_block.next_key = {code_address + 3 * opcode_size, mode, thumb_mode};
+
+    // BL and BLX are decoded as a single instruction, if both halves are translated together.
+    AddCodeRange((instruction & 0xE800'F800) == 0xE800'F000 ? sizeof(u32) : sizeof(u16));
+    emitter->SetGuestAddress(code_address);
     status = decode_thumb(instruction, *this);
 
     if (status == Status::Unimplemented) {
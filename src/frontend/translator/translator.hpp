@@ -68,6 +68,12 @@ private:
   void EmitFlushNoSwitch();
   void EmitLoadSPSRToCPSR();
 
+  // Record that the instruction at code_address is translated, see BasicBlock::code_ranges.
+  void AddCodeRange(u32 size);
+
+  // Record the return address of a call, see BasicBlock::return_keys.
+  void AddReturnKey(u32 return_address);
+
   // TODO: deduce opcode_size from thumb_mode. this is redundant.
   u32 code_address;
   bool thumb_mode;
@@ -3,47 +3,408 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <lunatic/cpu.hpp>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "frontend/ir_opt/constant_propagation.hpp"
 #include "frontend/ir_opt/context_load_store_elision.hpp"
 #include "frontend/ir_opt/dead_code_elision.hpp"
 #include "frontend/ir_opt/dead_flag_elision.hpp"
+#include "frontend/flag_liveness.hpp"
+#include "frontend/idle_loop_detection.hpp"
 #include "frontend/state.hpp"
 #include "frontend/translator/translator.hpp"
 
 #include "backend/backend.hpp"
+#include "common/arena_allocator.hpp"
+#include "persistent_cache.hpp"
+#include "profiler.hpp"
 
 using namespace lunatic::frontend;
 using namespace lunatic::backend;
 
 namespace lunatic {
 
-struct JIT final : CPU {
-  JIT(CPU::Descriptor const& descriptor)
+struct JITCodeCache final : CodeCache {
+  JITCodeCache(CPU::Descriptor const& descriptor)
       : exception_base(descriptor.exception_base)
       , memory(descriptor.memory)
-      , translator(descriptor) {
-    backend = Backend::CreateBackend(descriptor, state, block_cache, irq_line);
+      , coprocessors(descriptor.coprocessors)
+      , model(descriptor.model)
+      , block_size(descriptor.block_size)
+      , position_independent_code(descriptor.position_independent_code)
+      , enable_idle_loop_detection(descriptor.enable_idle_loop_detection)
+      , translator(descriptor)
+      , persistent_cache(descriptor) {
+    backend = Backend::CreateBackend(descriptor, block_cache);
+
+    auto dead_flag_elision_pass = std::make_unique<IRDeadFlagElisionPass>();
+
+    dead_flag_elision = dead_flag_elision_pass.get();
     passes.push_back(std::make_unique<IRContextLoadStoreElisionPass>());
-    passes.push_back(std::make_unique<IRDeadFlagElisionPass>());
+    passes.push_back(std::move(dead_flag_elision_pass));
     passes.push_back(std::make_unique<IRConstantPropagationPass>());
     passes.push_back(std::make_unique<IRDeadCodeElisionPass>());
   }
 
+ ~JITCodeCache() {
+    /* Release the basic blocks while the backend, the profiler and the lists which
+     * their release callbacks update are still alive. The members are destroyed in reverse order.
+     */
+    Flush();
+  }
+
+  // Release all basic blocks, or those in an address range, as a batch (see Backend::BeginRelease()).
+  void Flush() {
+    backend->BeginRelease();
+    block_cache.Flush();
+    backend->EndRelease();
+  }
+
+  void Flush(u32 address_lo, u32 address_hi) {
+    backend->BeginRelease();
+    block_cache.Flush(address_lo, address_hi);
+    backend->EndRelease();
+  }
+
+  bool IsCompatible(CPU::Descriptor const& descriptor) const {
+    if (descriptor.model != model ||
+        descriptor.block_size != block_size ||
+        descriptor.exception_base != exception_base ||
+        descriptor.position_independent_code != position_independent_code ||
+        descriptor.enable_idle_loop_detection != enable_idle_loop_detection) {
+      return false;
+    }
+
+    return position_independent_code ||
+      (&descriptor.memory == &memory && descriptor.coprocessors == coprocessors);
+  }
+
+  void SetExceptionBase(u32 new_exception_base) {
+    if (new_exception_base != this->exception_base) {
+      // this is expected to happen rarely, so we just invalidate all blocks that may cause an exception.
+      backend->BeginRelease();
+
+      while (!exception_causing_basic_blocks.empty()) {
+        block_cache.Set(exception_causing_basic_blocks.front()->key, nullptr);
+      }
+
+      backend->EndRelease();
+
+      translator.SetExceptionBase(new_exception_base);
+      persistent_cache.SetExceptionBase(new_exception_base);
+      this->exception_base = new_exception_base;
+    }
+  }
+
+  /* CPUs which share the code cache must not run concurrently (see CPU::GetCodeCache()).
+   * The thread, which runs or modifies the code cache, owns it until it is done. Meanwhile any other thread
+   * throws when it tries to do the same. Nested accesses on the owning thread, e.g. from a coprocessor, are fine.
+   * Not a std::runtime_error, which Precompile() would ignore.
+   */
+  struct AccessGuard {
+    explicit AccessGuard(JITCodeCache& code_cache) : owner(code_cache.owner) {
+      auto current_owner = std::thread::id{};
+      auto this_thread = std::this_thread::get_id();
+
+      if (!owner.compare_exchange_strong(current_owner, this_thread, std::memory_order_acquire)) {
+        if (current_owner != this_thread) {
+          throw std::logic_error(
+            "JIT: requirement not met: CPUs which share a code cache must not run concurrently.");
+        }
+        nested = true;
+      }
+    }
+
+   ~AccessGuard() {
+      if (!nested) {
+        owner.store(std::thread::id{}, std::memory_order_release);
+      }
+    }
+
+    std::atomic<std::thread::id>& owner;
+    bool nested = false;
+  };
+
+  auto Compile(BasicBlock::Key block_key, u32 hash) -> BasicBlock* {
+    // Do not leak the basic block if the translator encounters an unimplemented opcode.
+    auto owner = std::unique_ptr<BasicBlock>{new BasicBlock{block_key}};
+    auto basic_block = owner.get();
+
+    basic_block->hash = hash;
+
+    auto& compile_time = statistics.compile_time_ns;
+    auto time_start = Clock::now();
+
+    if (!persistent_cache.Restore(*basic_block, *backend)) {
+      translator.Translate(*basic_block);
+      compile_time.translate += GetNanosecondsSince(time_start);
+
+      time_start = Clock::now();
+      basic_block->flags_dead_on_entry = GetFlagsDeadOnEntry(*basic_block);
+      basic_block->flags_dead_on_exit = GetFlagsDeadOnExit(*basic_block, *basic_block);
+
+      // Recompile the predecessors, which can skip more flags now that this block is known.
+      InvalidateFlagDependents(*basic_block);
+      Optimize(basic_block);
+
+      if (enable_idle_loop_detection) {
+        basic_block->is_idle_loop = IsIdleLoop(*basic_block);
+      }
+      compile_time.optimize += GetNanosecondsSince(time_start);
+
+      time_start = Clock::now();
+      backend->Compile(*basic_block);
+    }
+
+    compile_time.backend += GetNanosecondsSince(time_start);
+    statistics.compiled_blocks++;
+    statistics.compiled_guest_instructions += basic_block->length;
+
+    owner.release();
+
+    if (basic_block->uses_exception_base) {
+      exception_causing_basic_blocks.push_back(basic_block);
+
+      basic_block->RegisterReleaseCallback([this](BasicBlock const& block) {
+        auto match = std::find(
+          exception_causing_basic_blocks.begin(), exception_causing_basic_blocks.end(), &block);
+
+        if (match != exception_causing_basic_blocks.end()) {
+          exception_causing_basic_blocks.erase(match);
+        }
+      });
+    }
+
+    AddFlagDependent(basic_block);
+
+    profiler.AddBasicBlock(*basic_block);
+
+    basic_block->RegisterReleaseCallback([this](BasicBlock const& block) {
+      profiler.RemoveBasicBlock(block);
+    });
+
+    block_cache.Set(block_key, basic_block);
+    basic_block->micro_blocks.clear();
+
+    // The IR of the basic block has been released, so the IR arena can be reused for the next basic block.
+    g_ir_arena.Reset();
+    return basic_block;
+  }
+
+  void Optimize(BasicBlock* basic_block) {
+    auto flags_dead_on_exit = GetFlagsDeadOnMicroBlockExit(*basic_block, basic_block->flags_dead_on_exit);
+    int i = 0;
+
+    for (auto &micro_block : basic_block->micro_blocks) {
+      dead_flag_elision->SetFlagsDeadOnExit(flags_dead_on_exit[i++]);
+
+      for (auto& pass : passes) {
+        pass->Run(micro_block.emitter);
+      }
+    }
+  }
+
+  template<typename Functor>
+  static void ForEachSuccessor(BasicBlock const& basic_block, Functor&& functor) {
+    auto const& branch_target = basic_block.branch_target;
+
+    if (branch_target.key) {
+      functor(branch_target.key);
+
+      if (branch_target.condition != Condition::AL) {
+        functor(basic_block.fallthrough_target.key);
+      }
+    }
+  }
+
+  /**
+   * Get the flags which are dead on entry to all statically known successors of a basic block.
+   * The successors are looked up in the block cache, except for the block which is being compiled.
+   */
+  auto GetFlagsDeadOnExit(BasicBlock const& basic_block, BasicBlock const& compiled_block) -> u8 {
+    // The successor is unknown, if the block ends in an indirect branch.
+    if (!basic_block.branch_target.key) {
+      return 0;
+    }
+
+    u8 flags_dead = kFlagsNZCV;
+
+    ForEachSuccessor(basic_block, [&](BasicBlock::Key key) {
+      if (key == compiled_block.key) {
+        flags_dead &= compiled_block.flags_dead_on_entry;
+      } else if (key == basic_block.key) {
+        flags_dead &= basic_block.flags_dead_on_entry;
+      } else {
+        auto successor = block_cache.Get(key);
+
+        flags_dead &= successor != nullptr ? successor->flags_dead_on_entry : 0;
+      }
+    });
+
+    return flags_dead;
+  }
+
+  /**
+   * Keep track of the predecessors of each block, which could skip computing more flags or
+   * which rely on the successor not reading some flags. The latter must be invalidated together with their successor.
+   */
+  void AddFlagDependent(BasicBlock* basic_block) {
+    auto updates_flags = false;
+
+    for (auto const& micro_block : basic_block->micro_blocks) {
+      for (auto const& op : micro_block.emitter.Code()) {
+        if (op->GetClass() == IROpcodeClass::UpdateFlags) {
+          updates_flags = true;
+        }
+      }
+    }
+
+    if (updates_flags || basic_block->flags_dead_on_exit != 0) {
+      ForEachSuccessor(*basic_block, [&](BasicBlock::Key key) {
+        if (key != basic_block->key) {
+          flag_dependents[key].push_back(basic_block);
+        }
+      });
+
+      basic_block->RegisterReleaseCallback([this](BasicBlock const& block) {
+        ForEachSuccessor(block, [&](BasicBlock::Key key) {
+          auto match = flag_dependents.find(key);
+
+          if (match != flag_dependents.end()) {
+            auto& dependents = match->second;
+
+            dependents.erase(std::remove(dependents.begin(), dependents.end(), &block), dependents.end());
+
+            if (dependents.empty()) {
+              flag_dependents.erase(match);
+            }
+          }
+        });
+      });
+    }
+
+    basic_block->RegisterReleaseCallback([this](BasicBlock const& block) {
+      InvalidateFlagDependents(block, true);
+    });
+  }
+
+  /**
+   * Invalidate the predecessors of a block, which were compiled for a different set of dead flags.
+   * This happens before the block is compiled, so that it does not link to predecessors which are released right away.
+   * If the block is released, all predecessors which rely on some flags being dead are invalidated.
+   */
+  void InvalidateFlagDependents(BasicBlock const& basic_block, bool released = false) {
+    auto match = flag_dependents.find(basic_block.key);
+
+    if (match == flag_dependents.end()) {
+      return;
+    }
+
+    /* Invalidating a block removes it from the list of dependents, and its release callback
+     * may release further dependents. So only keep the keys and look each block up again.
+     */
+    auto dependent_keys = std::vector<BasicBlock::Key>{};
+
+    for (auto dependent : match->second) {
+      dependent_keys.push_back(dependent->key);
+    }
+
+    backend->BeginRelease();
+
+    for (auto key : dependent_keys) {
+      auto dependent = block_cache.Get(key);
+
+      if (dependent == nullptr) {
+        continue;
+      }
+
+      if (released) {
+        if (dependent->flags_dead_on_exit != 0) {
+          block_cache.Set(dependent->key, nullptr);
+        }
+      } else if (GetFlagsDeadOnExit(*dependent, basic_block) != dependent->flags_dead_on_exit) {
+        block_cache.Set(dependent->key, nullptr);
+      }
+    }
+
+    backend->EndRelease();
+  }
+
+  using Clock = std::chrono::steady_clock;
+
+  static auto GetNanosecondsSince(Clock::time_point time_start) -> u64 {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - time_start).count();
+  }
+
+  u32 exception_base;
+  Memory& memory;
+  std::array<Coprocessor*, 16> coprocessors;
+  CPU::Descriptor::Model model;
+  int block_size;
+  bool position_independent_code;
+  bool enable_idle_loop_detection;
+  Translator translator;
+  PersistentCache persistent_cache;
+  Profiler profiler;
+  std::unordered_map<BasicBlock::Key, std::vector<BasicBlock*>> flag_dependents;
+  BasicBlockCache block_cache;
+  std::unique_ptr<Backend> backend;
+  std::vector<std::unique_ptr<IRPass>> passes;
+  IRDeadFlagElisionPass* dead_flag_elision;
+  std::vector<BasicBlock*> exception_causing_basic_blocks;
+  CPU::Statistics statistics;
+  std::atomic<std::thread::id> owner{};
+};
+
+struct JIT final : CPU {
+  JIT(CPU::Descriptor const& descriptor) : memory(descriptor.memory) {
+    if (descriptor.code_cache) {
+      code_cache = std::static_pointer_cast<JITCodeCache>(descriptor.code_cache);
+
+      if (!code_cache->IsCompatible(descriptor)) {
+        throw std::runtime_error(
+          "JIT: requirement not met: the shared code cache must have been created for the same "
+          "memory, coprocessors, model, block size and exception base.");
+      }
+    } else {
+      code_cache = std::make_shared<JITCodeCache>(descriptor);
+    }
+
+    code_cache->backend->InitializeContext(context, descriptor);
+
+    auto dispatch = [](JIT* jit) -> BasicBlock::CompiledFn {
+      return jit->Dispatch();
+    };
+
+    context.dispatch = Context::Call{u64(+dispatch), u64(this)};
+  }
+
   void Reset() override {
-    irq_line = false;
+    IRQLine() = false;
     wait_for_irq = false;
+    state.GetRequests().store(0, std::memory_order_release);
     cycles_to_run = 0;
     state.Reset();
-    SetGPR(GPR::PC, exception_base);
-    block_cache.Flush();
-    exception_causing_basic_blocks.clear();
+    SetGPR(GPR::PC, code_cache->exception_base);
+
+    // Other CPUs may still use the compiled code, so it only is discarded if the code cache is not shared.
+    if (code_cache.use_count() == 1) {
+      auto guard = JITCodeCache::AccessGuard{*code_cache};
+
+      code_cache->Flush();
+      code_cache->statistics.flushes++;
+      code_cache->exception_causing_basic_blocks.clear();
+    }
   }
 
   auto IRQLine() -> bool& override {
-    return irq_line;
+    return state.GetIRQLine();
   }
 
   auto WaitForIRQ() -> bool& override {
@@ -51,32 +412,128 @@ struct JIT final : CPU {
   }
 
   auto GetExceptionBase() const -> u32 {
-    return exception_base;
+    return code_cache->exception_base;
   }
 
   void SetExceptionBase(u32 new_exception_base) override {
-    if (new_exception_base != this->exception_base) {
-      // this is expected to happen rarely, so we just invalidate all blocks that may cause an exception.
-      while (!exception_causing_basic_blocks.empty()) {
-        block_cache.Set(exception_causing_basic_blocks.front()->key, nullptr);
-      }
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
 
-      translator.SetExceptionBase(new_exception_base);
-      this->exception_base = new_exception_base;
-    }
+    code_cache->SetExceptionBase(new_exception_base);
   }
 
   void ClearICache() override {
-    block_cache.Flush();
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
+
+    code_cache->Flush();
+    code_cache->statistics.flushes++;
   }
 
   void ClearICacheRange(u32 address_lo, u32 address_hi) override {
-    block_cache.Flush(address_lo, address_hi);
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
+
+    code_cache->Flush(address_lo, address_hi);
+    code_cache->statistics.range_invalidations++;
+  }
+
+  void Precompile(u32 address_lo, u32 address_hi, Mode mode, bool thumb) override {
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
+
+    auto in_range = [&](BasicBlock::Key key) {
+      auto opcode_size = key.Thumb() ? sizeof(u16) : sizeof(u32);
+      auto address = key.Address() - 2 * opcode_size;
+
+      return key && address >= address_lo && address <= address_hi;
+    };
+
+    auto opcode_size = thumb ? sizeof(u16) : sizeof(u32);
+    auto worklist = std::vector<BasicBlock::Key>{
+      BasicBlock::Key{u32(address_lo + 2 * opcode_size), mode, thumb},
+      BasicBlock::Key{state}
+    };
+
+    while (!worklist.empty()) {
+      auto block_key = worklist.back();
+
+      worklist.pop_back();
+
+      if (!in_range(block_key) || code_cache->block_cache.Get(block_key) != nullptr) {
+        continue;
+      }
+
+      BasicBlock* basic_block;
+
+      try {
+        basic_block = code_cache->Compile(block_key, GetBasicBlockHash(block_key));
+      } catch (std::runtime_error const&) {
+        // The region may contain data, which should not be compiled ahead-of-time.
+        continue;
+      }
+
+      auto const& branch_target = basic_block->branch_target;
+
+      /* Unless the basic block ends in an unconditional jump, execution may continue after its last instruction.
+       * This also covers basic blocks which end in an instruction that writes the PC, but is not a branch.
+       */
+      if (!branch_target.key || branch_target.condition != Condition::AL) {
+        worklist.push_back(basic_block->next_key);
+      }
+
+      // Calls usually return, even though the return address is only known at runtime.
+      for (auto return_key : basic_block->return_keys) {
+        worklist.push_back(return_key);
+      }
+
+      // Compiling the branch target next allows Link() to patch the jump right away.
+      worklist.push_back(branch_target.key);
+    }
+  }
+
+  auto GetCodeCache() -> std::shared_ptr<CodeCache> override {
+    return code_cache;
+  }
+
+  bool LoadCodeCache(std::string const& path) override {
+    RequirePositionIndependentCode("LoadCodeCache");
+
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
+
+    return code_cache->persistent_cache.Load(path, *code_cache->backend);
+  }
+
+  bool SaveCodeCache(std::string const& path) override {
+    RequirePositionIndependentCode("SaveCodeCache");
+
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
+
+    return code_cache->persistent_cache.Save(path, code_cache->block_cache, *code_cache->backend);
+  }
+
+  void RequestInterrupt() override {
+    state.GetRequests().fetch_or(kRequestInterrupt, std::memory_order_release);
+  }
+
+  void RequestHalt() override {
+    state.GetRequests().fetch_or(kRequestHalt, std::memory_order_release);
+  }
+
+  void RequestExit() override {
+    state.GetRequests().fetch_or(kRequestExit, std::memory_order_release);
   }
 
   auto Run(int cycles) -> int override {
+    auto guard = JITCodeCache::AccessGuard{*code_cache};
+    auto& requests = state.GetRequests();
+
+    state.GetIdleLoopFlag() = false;
+
     if (WaitForIRQ() && !IRQLine()) {
-      return 0;
+      auto pending = requests.load(std::memory_order_acquire);
+
+      if (~pending & kRequestInterrupt) {
+        // The CPU already is halted, so halt and exit requests have been served.
+        requests.fetch_and(~(pending & (kRequestHalt | kRequestExit)), std::memory_order_acq_rel);
+        return 0;
+      }
     }
 
     cycles_to_run += cycles;
@@ -84,19 +541,35 @@ struct JIT final : CPU {
     int cycles_available = cycles_to_run;
 
     while (cycles_to_run > 0) {
-      if (IRQLine()) {
-        SignalIRQ();
-      }
+      auto pending = requests.load(std::memory_order_acquire);
 
-      auto block_key = BasicBlock::Key{state};
-      auto basic_block = block_cache.Get(block_key);
-      auto hash = GetBasicBlockHash(block_key);
+      if (pending & (kRequestHalt | kRequestExit)) {
+        requests.fetch_and(~(pending & (kRequestHalt | kRequestExit)), std::memory_order_acq_rel);
+
+        if (pending & kRequestHalt) {
+          wait_for_irq = true;
+        }
 
-      if (basic_block == nullptr || basic_block->hash != hash) {
-        basic_block = Compile(block_key);
+        int cycles_executed = cycles_available - cycles_to_run;
+        cycles_to_run = 0;
+        return cycles_executed;
+      }
+
+      if (IRQLine() || (pending & kRequestInterrupt)) {
+        if (SignalIRQ() && (pending & kRequestInterrupt)) {
+          requests.fetch_and(~kRequestInterrupt, std::memory_order_acq_rel);
+        }
       }
 
-      cycles_to_run = backend->Call(*basic_block, cycles_to_run);
+      auto basic_block = GetCurrentBasicBlock();
+
+      cycles_to_run = code_cache->backend->Call(*basic_block, context, cycles_to_run);
+      returns_to_dispatcher++;
+
+      // Resolve the samples before any block they refer to can be released.
+      if (code_cache->profiler.IsActive()) {
+        code_cache->profiler.ResolveSamples();
+      }
 
       if (WaitForIRQ()) {
         int cycles_executed = cycles_available - cycles_to_run;
@@ -108,6 +581,34 @@ struct JIT final : CPU {
     return cycles_available - cycles_to_run;
   }
 
+  bool InIdleLoop() const override {
+    return state.GetIdleLoopFlag();
+  }
+
+  auto GetStatistics() const -> Statistics override {
+    auto statistics = code_cache->statistics;
+    auto backend_statistics = code_cache->backend->GetStatistics();
+
+    statistics.code_buffer_bytes = backend_statistics.code_buffer_bytes;
+    statistics.flushes += backend_statistics.flushes;
+    statistics.link_patches = backend_statistics.link_patches;
+    statistics.dispatch_misses = context.dispatch_misses;
+    statistics.returns_to_dispatcher = returns_to_dispatcher;
+    return statistics;
+  }
+
+  void StartProfiling(int interval_us) override {
+    code_cache->profiler.Start(interval_us);
+  }
+
+  void StopProfiling() override {
+    code_cache->profiler.Stop();
+  }
+
+  auto GetProfile() -> Profile override {
+    return code_cache->profiler.GetProfile();
+  }
+
   auto GetGPR(GPR reg) const -> u32 override {
     return GetGPR(reg, GetCPSR().f.mode);
   }
@@ -149,42 +650,64 @@ struct JIT final : CPU {
   }
 
 private:
-  auto Compile(BasicBlock::Key block_key) -> BasicBlock* {
-    auto basic_block = new BasicBlock{block_key};
+  void RequirePositionIndependentCode(char const* method) {
+    if (!code_cache->position_independent_code) {
+      throw std::runtime_error(
+        std::string{method} + ": requirement not met: position-independent code must be enabled.");
+    }
+  }
 
-    basic_block->hash = GetBasicBlockHash(block_key);
+  /**
+   * Called by compiled code, when a basic block returns to the dispatcher with cycles left.
+   * Takes pending IRQs and compiles the next basic block on a cache miss, so that compiled code
+   * only returns to Run() once it ran out of cycles, or to serve a halt or exit request.
+   * Returns the compiled code to continue with, or zero to return to Run().
+   */
+  auto Dispatch() -> BasicBlock::CompiledFn {
+    auto& requests = state.GetRequests();
+    auto pending = requests.load(std::memory_order_acquire);
+
+    // Resolve the samples before any block they refer to can be released.
+    if (code_cache->profiler.IsActive()) {
+      code_cache->profiler.ResolveSamples();
+    }
 
-    translator.Translate(*basic_block);
-    Optimize(basic_block);
+    if (WaitForIRQ() || (pending & (kRequestHalt | kRequestExit))) {
+      return 0;
+    }
 
-    if (basic_block->uses_exception_base) {
-      exception_causing_basic_blocks.push_back(basic_block);
+    if (IRQLine() || (pending & kRequestInterrupt)) {
+      if (SignalIRQ() && (pending & kRequestInterrupt)) {
+        requests.fetch_and(~kRequestInterrupt, std::memory_order_acq_rel);
+      }
+    }
 
-      basic_block->RegisterReleaseCallback([this](BasicBlock const& block) {
-        auto match = std::find(
-          exception_causing_basic_blocks.begin(), exception_causing_basic_blocks.end(), &block);
+    BasicBlock* basic_block;
 
-        if (match != exception_causing_basic_blocks.end()) {
-          exception_causing_basic_blocks.erase(match);
-        }
-      });
+    // Exceptions cannot unwind through compiled code. Let Run() compile the block again and report the error.
+    try {
+      basic_block = GetCurrentBasicBlock();
+    } catch (...) {
+      return 0;
     }
 
-    backend->Compile(*basic_block);
-    block_cache.Set(block_key, basic_block);
-    basic_block->micro_blocks.clear();
-    return basic_block;
+    return code_cache->backend->GetEntryPoint(*basic_block);
   }
 
-  void Optimize(BasicBlock* basic_block) {
-    for (auto &micro_block : basic_block->micro_blocks) {
-      for (auto& pass : passes) {
-        pass->Run(micro_block.emitter);
-      }
+  // Get the basic block at the current PC and mode from the block cache, or compile it.
+  auto GetCurrentBasicBlock() -> BasicBlock* {
+    auto block_key = BasicBlock::Key{state};
+    auto basic_block = code_cache->block_cache.Get(block_key);
+    auto hash = GetBasicBlockHash(block_key);
+
+    if (basic_block == nullptr || basic_block->hash != hash) {
+      basic_block = code_cache->Compile(block_key, hash);
     }
+
+    return basic_block;
   }
 
-  void SignalIRQ() {
+  bool SignalIRQ() {
     auto& cpsr = GetCPSR();
 
     wait_for_irq = false;
@@ -201,8 +724,11 @@ private:
       }
       cpsr.f.thumb = 0;
 
-      GetGPR(GPR::PC) = exception_base + 0x18 + sizeof(u32) * 2;
+      GetGPR(GPR::PC) = code_cache->exception_base + 0x18 + sizeof(u32) * 2;
+      return true;
     }
+
+    return false;
   }
 
   auto GetBasicBlockHash(BasicBlock::Key block_key) -> u32 {
@@ -225,17 +751,19 @@ private:
     return *state.GetPointerToSPSR(mode);
   }
 
-  bool irq_line = false;
+  enum Request : u32 {
+    kRequestInterrupt = 1 << 0,
+    kRequestHalt = 1 << 1,
+    kRequestExit = 1 << 2
+  };
+
   bool wait_for_irq = false;
   int cycles_to_run = 0;
-  u32 exception_base;
+  u64 returns_to_dispatcher = 0;
   Memory& memory;
-  State state;
-  Translator translator;
-  BasicBlockCache block_cache;
-  std::unique_ptr<Backend> backend;
-  std::vector<std::unique_ptr<IRPass>> passes;
-  std::vector<BasicBlock*> exception_causing_basic_blocks;
+  Context context;
+  State& state = context.state;
+  std::shared_ptr<JITCodeCache> code_cache;
 };
 
 auto CreateCPU(CPU::Descriptor const& descriptor) -> std::unique_ptr<CPU> {
@@ -0,0 +1,360 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#include "persistent_cache.hpp"
+
+using namespace lunatic::frontend;
+
+namespace lunatic {
+
+PersistentCache::PersistentCache(CPU::Descriptor const& descriptor)
+    : memory(descriptor.memory)
+    , model(descriptor.model)
+    , block_size(descriptor.block_size)
+    , exception_base(descriptor.exception_base)
+    , enable_idle_loop_detection(descriptor.enable_idle_loop_detection) {
+}
+
+bool PersistentCache::Load(std::string const& path, backend::Backend const& backend) {
+  auto file = std::ifstream{path, std::ios::binary};
+
+  if (!file) {
+    return false;
+  }
+
+  auto buffer = std::vector<u8>{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+  auto expected_header = GetHeader();
+
+  if (buffer.size() < sizeof(Header) ||
+      std::memcmp(buffer.data(), &expected_header, sizeof(Header)) != 0) {
+    return false;
+  }
+
+  auto new_entries = std::unordered_map<u64, Entry>{};
+  auto offset = sizeof(Header);
+
+  // Reject the whole file if any record is malformed, since the file is likely corrupted.
+  while (offset < buffer.size()) {
+    auto entry = Entry{};
+    auto& record = entry.record;
+
+    if (buffer.size() - offset < sizeof(Record)) {
+      return false;
+    }
+
+    std::memcpy(&record, &buffer[offset], sizeof(Record));
+    entry.offset = offset + sizeof(Record);
+
+    // A basic block consists of at most block_size instructions, each of which is at most four bytes long.
+    if (record.length <= 0 || record.length > block_size ||
+        record.number_of_code_ranges == 0 || record.number_of_code_ranges > record.length ||
+        record.number_of_return_keys > record.length) {
+      return false;
+    }
+
+    if (buffer.size() - entry.offset < entry.GetPayloadSize() ||
+        record.checksum != GetChecksum(record, buffer.data() + entry.offset, entry.GetPayloadSize())) {
+      return false;
+    }
+
+    u64 code_size = 0;
+
+    for (int i = 0; i < record.number_of_code_ranges; i++) {
+      auto code_range = BasicBlock::CodeRange{};
+
+      std::memcpy(&code_range, &buffer[entry.offset + i * sizeof(code_range)], sizeof(code_range));
+      code_size += code_range.size;
+    }
+
+    if (code_size > sizeof(u32) * record.length) {
+      return false;
+    }
+
+    // Malformed code would make linking write outside of the block.
+    if (!backend.IsValidSerialization(buffer.data() + entry.GetCodeOffset(), record.size)) {
+      return false;
+    }
+
+    new_entries[record.key] = entry;
+    offset = entry.offset + entry.GetPayloadSize();
+  }
+
+  data = std::move(buffer);
+  entries = std::move(new_entries);
+  return true;
+}
+
+bool PersistentCache::Save(
+  std::string const& path,
+  BasicBlockCache const& block_cache,
+  backend::Backend& backend
+) {
+  auto buffer = std::vector<u8>{};
+  auto header = GetHeader();
+
+  buffer.resize(sizeof(Header));
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+
+  block_cache.ForEach([&](BasicBlock const& basic_block) {
+    // The code of the block depends on its successors, which may change in the next session.
+    if (basic_block.flags_dead_on_exit != 0) {
+      return;
+    }
+
+    auto const& code_ranges = basic_block.code_ranges;
+    auto const& return_keys = basic_block.return_keys;
+
+    auto offset = buffer.size();
+    auto payload_offset = offset + sizeof(Record);
+    auto return_keys_offset = payload_offset + code_ranges.size() * sizeof(BasicBlock::CodeRange);
+    auto code_offset = return_keys_offset + return_keys.size() * sizeof(u64);
+
+    buffer.resize(code_offset);
+    std::memcpy(&buffer[payload_offset], code_ranges.data(), code_ranges.size() * sizeof(BasicBlock::CodeRange));
+
+    for (size_t i = 0; i < return_keys.size(); i++) {
+      std::memcpy(&buffer[return_keys_offset + i * sizeof(u64)], &return_keys[i].value, sizeof(u64));
+    }
+
+    if (!backend.Serialize(basic_block, buffer)) {
+      buffer.resize(offset);
+      return;
+    }
+
+    // Zero-initialize the reserved bytes, so that no uninitialized memory is written to the file.
+    auto record = Record{};
+
+    std::memset(&record, 0, sizeof(Record));
+    record.key = basic_block.key.value;
+    record.branch_target_key = basic_block.branch_target.key.value;
+    record.fallthrough_target_key = basic_block.fallthrough_target.key.value;
+    record.next_key = basic_block.next_key.value;
+    record.hash = basic_block.hash;
+    record.content_hash = GetContentHash(code_ranges);
+    record.length = basic_block.length;
+    record.size = u32(buffer.size() - code_offset);
+    record.number_of_code_ranges = u16(code_ranges.size());
+    record.number_of_return_keys = u16(return_keys.size());
+    record.branch_target_condition = u8(basic_block.branch_target.condition);
+    record.enable_fast_dispatch = basic_block.enable_fast_dispatch;
+    record.uses_exception_base = basic_block.uses_exception_base;
+    record.is_idle_loop = basic_block.is_idle_loop;
+    record.checksum = GetChecksum(record, &buffer[payload_offset], buffer.size() - payload_offset);
+
+    std::memcpy(&buffer[offset], &record, sizeof(Record));
+  });
+
+  // Keep the blocks which have not been dispatched in this session.
+  for (auto const& [key, entry] : entries) {
+    auto begin = data.begin() + entry.offset - sizeof(Record);
+
+    buffer.insert(buffer.end(), begin, begin + sizeof(Record) + entry.GetPayloadSize());
+  }
+
+  /* Write to a temporary file first and rename it over the target, so that a crash
+   * or a concurrent save never leaves a partially written cache file behind.
+   */
+  auto temporary_path = path + "." + std::to_string(std::random_device{}()) + ".tmp";
+
+  {
+    auto file = std::ofstream{temporary_path, std::ios::binary | std::ios::trunc};
+
+    if (!file) {
+      return false;
+    }
+
+    file.write((char const*)buffer.data(), buffer.size());
+    file.close();
+
+    if (!file) {
+      std::remove(temporary_path.c_str());
+      return false;
+    }
+  }
+
+  auto error = std::error_code{};
+
+  std::filesystem::rename(temporary_path, path, error);
+
+  if (error) {
+    std::remove(temporary_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool PersistentCache::Restore(BasicBlock& basic_block, backend::Backend& backend) {
+  auto match = entries.find(basic_block.key.value);
+
+  if (match == entries.end()) {
+    return false;
+  }
+
+  auto entry = match->second;
+
+  // Each block is restored at most once. After that it is owned by the block cache.
+  entries.erase(match);
+
+  auto const& record = entry.record;
+  auto code_ranges = std::vector<BasicBlock::CodeRange>(record.number_of_code_ranges);
+  auto return_keys_offset = entry.offset + code_ranges.size() * sizeof(BasicBlock::CodeRange);
+
+  std::memcpy(code_ranges.data(), &data[entry.offset], code_ranges.size() * sizeof(BasicBlock::CodeRange));
+
+  if (record.hash != basic_block.hash ||
+      record.content_hash != GetContentHash(code_ranges) ||
+      (record.is_idle_loop && !enable_idle_loop_detection)) {
+    return false;
+  }
+
+  for (int i = 0; i < record.number_of_return_keys; i++) {
+    u64 return_key;
+
+    std::memcpy(&return_key, &data[return_keys_offset + i * sizeof(u64)], sizeof(u64));
+    basic_block.return_keys.push_back(BasicBlock::Key{return_key});
+  }
+
+  basic_block.code_ranges = std::move(code_ranges);
+  basic_block.next_key = BasicBlock::Key{record.next_key};
+  basic_block.length = record.length;
+  basic_block.branch_target.key = BasicBlock::Key{record.branch_target_key};
+  basic_block.branch_target.condition = Condition(record.branch_target_condition);
+  basic_block.fallthrough_target.key = BasicBlock::Key{record.fallthrough_target_key};
+  basic_block.enable_fast_dispatch = record.enable_fast_dispatch;
+  basic_block.uses_exception_base = record.uses_exception_base;
+  basic_block.is_idle_loop = record.is_idle_loop;
+
+  backend.Deserialize(basic_block, data.data() + entry.GetCodeOffset(), record.size);
+  return true;
+}
+
+void PersistentCache::SetExceptionBase(u32 new_exception_base) {
+  if (new_exception_base != exception_base) {
+    for (auto it = entries.begin(); it != entries.end();) {
+      if (it->second.record.uses_exception_base) {
+        it = entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    exception_base = new_exception_base;
+  }
+}
+
+auto PersistentCache::GetHeader() const -> Header {
+  auto header = Header{};
+
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.model = u32(model);
+  header.block_size = block_size;
+  header.exception_base = exception_base;
+  header.layout = GetLayoutFingerprint();
+  return header;
+}
+
+// FNV-1a, which is used for all hashes in the file.
+static void HashBytes(u32& hash, void const* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ ((u8 const*)data)[i]) * 0x01000193;
+  }
+}
+
+static constexpr u32 kHashSeed = 0x811C9DC5;
+
+/**
+ * Compiled code embeds offsets into the guest state and the backend context.
+ * Any change to their layout, e.g. by a different version or build of the library, invalidates the file.
+ */
+auto PersistentCache::GetLayoutFingerprint() -> u32 {
+  using backend::Context;
+
+  auto hash = kHashSeed;
+
+  auto add = [&](uintptr value) {
+    HashBytes(hash, &value, sizeof(value));
+  };
+
+  add(sizeof(State));
+  add(State::GetOffsetToCPSR());
+  add(State::GetOffsetToIRQLine());
+  add(State::GetOffsetToRequests());
+  add(State::GetOffsetToIdleLoopFlag());
+
+  for (auto mode : {Mode::User, Mode::FIQ, Mode::IRQ, Mode::Supervisor, Mode::Abort, Mode::Undefined, Mode::System}) {
+    for (int reg = 0; reg < 16; reg++) {
+      add(State::GetOffsetToGPR(mode, GPR(reg)));
+    }
+
+    if (mode != Mode::User && mode != Mode::System) {
+      add(State::GetOffsetToSPSR(mode));
+    }
+  }
+
+  add(sizeof(Context));
+  add(offsetof(Context, block_cache));
+  add(offsetof(Context, pagetable));
+  add(offsetof(Context, itcm));
+  add(offsetof(Context, dtcm));
+  add(offsetof(Context, read_byte));
+  add(offsetof(Context, write_word));
+  add(offsetof(Context, coprocessor_read));
+  add(offsetof(Context, coprocessor_write));
+  add(offsetof(Context, dispatch));
+  add(offsetof(Context, dispatch_misses));
+  add(sizeof(Memory::TCM));
+  add(offsetof(Memory::TCM, data));
+  add(offsetof(Memory::TCM, mask));
+  add(offsetof(Memory::TCM, config) + offsetof(Memory::TCM::Config, enable_read));
+  add(offsetof(Memory::TCM, config) + offsetof(Memory::TCM::Config, base));
+  add(offsetof(Memory::TCM, config) + offsetof(Memory::TCM::Config, limit));
+  return hash;
+}
+
+auto PersistentCache::GetChecksum(Record record, u8 const* payload, size_t payload_size) -> u32 {
+  auto hash = kHashSeed;
+
+  record.checksum = 0;
+  HashBytes(hash, &record, sizeof(Record));
+  HashBytes(hash, payload, payload_size);
+  return hash;
+}
+
+auto PersistentCache::Entry::GetPayloadSize() const -> size_t {
+  return GetCodeOffset() - offset + record.size;
+}
+
+auto PersistentCache::Entry::GetCodeOffset() const -> size_t {
+  return offset + record.number_of_code_ranges * sizeof(BasicBlock::CodeRange) + record.number_of_return_keys * sizeof(u64);
+}
+
+auto PersistentCache::GetContentHash(std::vector<BasicBlock::CodeRange> const& code_ranges) -> u32 {
+  auto hash = kHashSeed;
+
+  // Hash the guest code which the basic block was translated from, which is made of halfwords in both ARM and Thumb.
+  for (auto const& code_range : code_ranges) {
+    for (u32 offset = 0; offset < code_range.size; offset += sizeof(u16)) {
+      auto halfword = memory.FastRead<u16, Memory::Bus::Code>(code_range.address + offset);
+
+      HashBytes(hash, &halfword, sizeof(halfword));
+    }
+  }
+
+  return hash;
+}
+
+} // namespace lunatic
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <lunatic/cpu.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "backend/backend.hpp"
+#include "frontend/basic_block_cache.hpp"
+
+namespace lunatic {
+
+/**
+ * On-disk cache of compiled basic blocks.
+ * Blocks are looked up by their key once they are first dispatched and are only
+ * restored if the guest code still matches the code that they were compiled from.
+ */
+struct PersistentCache {
+  PersistentCache(CPU::Descriptor const& descriptor);
+
+  bool Load(std::string const& path, backend::Backend const& backend);
+
+  bool Save(
+    std::string const& path,
+    frontend::BasicBlockCache const& block_cache,
+    backend::Backend& backend
+  );
+
+  bool Restore(frontend::BasicBlock& basic_block, backend::Backend& backend);
+
+  void SetExceptionBase(u32 new_exception_base);
+
+private:
+  static constexpr u32 kMagic = 0x434E554C; // 'LUNC'
+  static constexpr u32 kVersion = 4;
+
+  // The structures below are written to disk as they are, so they must not contain padding.
+  struct Header {
+    u32 magic;
+    u32 version;
+    u32 model;
+    s32 block_size;
+    u32 exception_base;
+    u32 layout; // see GetLayoutFingerprint()
+  };
+
+  /**
+   * Each record is followed by its payload: the code ranges of the basic block,
+   * the keys of its return addresses and finally its serialized code.
+   */
+  struct Record {
+    u64 key;
+    u64 branch_target_key;
+    u64 fallthrough_target_key;
+    u64 next_key;
+    u32 hash;
+    u32 content_hash;
+    u32 checksum; // of the record and its payload, with this field set to zero
+    s32 length;
+    u32 size;     // of the serialized code
+    u16 number_of_code_ranges;
+    u16 number_of_return_keys;
+    u8  branch_target_condition;
+    u8  enable_fast_dispatch;
+    u8  uses_exception_base;
+    u8  is_idle_loop;
+    u8  reserved[4];
+  };
+
+  static_assert(sizeof(Header) == 24 && sizeof(Record) == 64, "PersistentCache: file structures must not be padded");
+
+  struct Entry {
+    Record record;
+    size_t offset; // of the payload
+
+    auto GetPayloadSize() const -> size_t;
+    auto GetCodeOffset() const -> size_t;
+  };
+
+  auto GetHeader() const -> Header;
+  auto GetContentHash(std::vector<frontend::BasicBlock::CodeRange> const& code_ranges) -> u32;
+  static auto GetChecksum(Record record, u8 const* payload, size_t payload_size) -> u32;
+  static auto GetLayoutFingerprint() -> u32;
+
+  Memory& memory;
+  CPU::Descriptor::Model model;
+  int block_size;
+  u32 exception_base;
+  bool enable_idle_loop_detection;
+
+  std::vector<u8> data;
+  std::unordered_map<u64, Entry> entries;
+};
+
+} // namespace lunatic
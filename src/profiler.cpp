@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef __linux__
+  #include <csignal>
+  #include <ctime>
+  #include <sys/syscall.h>
+  #include <ucontext.h>
+  #include <unistd.h>
+
+  #ifndef sigev_notify_thread_id
+    #define sigev_notify_thread_id _sigev_un._tid
+  #endif
+#endif
+
+#include "profiler.hpp"
+
+using namespace lunatic::frontend;
+
+namespace lunatic {
+
+#ifdef __linux__
+
+// There is only one SIGPROF handler per process, so only one profiler may be active at a time.
+static std::atomic<Profiler::SampleBuffer*> g_sample_buffer{nullptr};
+static struct sigaction g_previous_action;
+static timer_t g_timer;
+
+static void OnSignal(int signal, siginfo_t* info, void* context) {
+  auto sample_buffer = g_sample_buffer.load(std::memory_order_relaxed);
+
+  if (sample_buffer) {
+    auto host_pc = uintptr(((ucontext_t*)context)->uc_mcontext.gregs[REG_RIP]);
+    auto write_index = sample_buffer->write_index.load(std::memory_order_relaxed);
+
+    sample_buffer->host_pc[write_index % Profiler::kSampleBufferSize] = host_pc;
+    sample_buffer->write_index.store(write_index + 1, std::memory_order_release);
+  }
+}
+
+#endif
+
+Profiler::~Profiler() {
+  Stop();
+}
+
+void Profiler::Start(int interval_us) {
+  if (active) {
+    return;
+  }
+
+  if (interval_us <= 0) {
+    throw std::runtime_error("Profiler: requirement not met: the sampling interval must be positive.");
+  }
+
+#ifdef __linux__
+  auto expected = (SampleBuffer*)nullptr;
+
+  if (!g_sample_buffer.compare_exchange_strong(expected, &sample_buffer)) {
+    throw std::runtime_error("Profiler: requirement not met: only one CPU may be profiled at a time.");
+  }
+
+  samples.clear();
+  samples_total = 0;
+  samples_outside_guest_code = 0;
+  samples_dropped = 0;
+  read_index = sample_buffer.write_index.load(std::memory_order_acquire);
+
+  struct sigaction action {};
+
+  action.sa_sigaction = OnSignal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, &g_previous_action);
+
+  // Sample the CPU time of the calling thread only, which is expected to be the thread running the CPU.
+  struct sigevent event {};
+
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = syscall(SYS_gettid);
+
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &g_timer) != 0) {
+    sigaction(SIGPROF, &g_previous_action, nullptr);
+    g_sample_buffer = nullptr;
+    throw std::runtime_error("Profiler: failed to create the sampling timer.");
+  }
+
+  struct itimerspec interval {};
+
+  interval.it_interval.tv_sec = interval_us / 1000000;
+  interval.it_interval.tv_nsec = (interval_us % 1000000) * 1000;
+  interval.it_value = interval.it_interval;
+  timer_settime(g_timer, 0, &interval, nullptr);
+
+  active = true;
+#else
+  throw std::runtime_error("Profiler: requirement not met: sampling is only supported on Linux.");
+#endif
+}
+
+void Profiler::Stop() {
+  if (!active) {
+    return;
+  }
+
+#ifdef __linux__
+  timer_delete(g_timer);
+
+  /* A signal from the timer may still be pending. Consume it while SIGPROF is blocked,
+   * instead of delivering it to the previous handler, which by default terminates the process.
+   */
+  sigset_t sigprof_set;
+  sigset_t previous_set;
+
+  sigemptyset(&sigprof_set);
+  sigaddset(&sigprof_set, SIGPROF);
+  pthread_sigmask(SIG_BLOCK, &sigprof_set, &previous_set);
+
+  auto no_timeout = timespec{};
+
+  while (sigtimedwait(&sigprof_set, nullptr, &no_timeout) == SIGPROF) {
+  }
+
+  /* The timer signals the thread which started the profiler. If Stop() is called on another thread,
+   * a signal may arrive even later. In that case keep ignoring it, unless there was a handler before.
+   */
+  auto restored_action = g_previous_action;
+
+  if (!(restored_action.sa_flags & SA_SIGINFO) && restored_action.sa_handler == SIG_DFL) {
+    restored_action.sa_handler = SIG_IGN;
+  }
+
+  sigaction(SIGPROF, &restored_action, nullptr);
+  pthread_sigmask(SIG_SETMASK, &previous_set, nullptr);
+  ResolveSamples();
+  g_sample_buffer = nullptr;
+#endif
+
+  active = false;
+}
+
+void Profiler::AddBasicBlock(BasicBlock const& basic_block) {
+  host_code_map[basic_block.function] = &basic_block;
+}
+
+void Profiler::RemoveBasicBlock(BasicBlock const& basic_block) {
+  auto match = host_code_map.find(basic_block.function);
+
+  if (match != host_code_map.end() && match->second == &basic_block) {
+    host_code_map.erase(match);
+  }
+}
+
+void Profiler::ResolveSamples() {
+  auto write_index = sample_buffer.write_index.load(std::memory_order_acquire);
+
+  if (write_index - read_index > kSampleBufferSize) {
+    samples_dropped += write_index - read_index - kSampleBufferSize;
+    read_index = write_index - kSampleBufferSize;
+  }
+
+  while (read_index != write_index) {
+    Resolve(sample_buffer.host_pc[read_index % kSampleBufferSize]);
+    read_index++;
+  }
+}
+
+auto Profiler::GetProfile() -> CPU::Profile {
+  auto profile = CPU::Profile{};
+
+  ResolveSamples();
+
+  for (auto const& [id, count] : samples) {
+    auto key = BasicBlock::Key{id.first};
+    auto opcode_size = key.Thumb() ? sizeof(u16) : sizeof(u32);
+    auto block_address = key.Address() - 2 * opcode_size;
+
+    profile.entries.push_back({
+      id.second,
+      u32(block_address),
+      key.Mode(),
+      key.Thumb(),
+      count
+    });
+  }
+
+  std::sort(profile.entries.begin(), profile.entries.end(), [](auto const& a, auto const& b) {
+    return a.samples > b.samples;
+  });
+
+  profile.samples = samples_total;
+  profile.samples_outside_guest_code = samples_outside_guest_code;
+  profile.samples_dropped = samples_dropped;
+  return profile;
+}
+
+void Profiler::Resolve(uintptr host_pc) {
+  samples_total++;
+
+  auto match = host_code_map.upper_bound(host_pc);
+
+  if (match == host_code_map.begin()) {
+    samples_outside_guest_code++;
+    return;
+  }
+
+  auto basic_block = std::prev(match)->second;
+  auto host_offset = host_pc - basic_block->function;
+
+  if (host_offset >= basic_block->function_size) {
+    samples_outside_guest_code++;
+    return;
+  }
+
+  auto const& host_mapping = basic_block->host_mapping;
+
+  // Find the last guest instruction whose code begins at or before the sampled address.
+  auto mapping = std::upper_bound(host_mapping.begin(), host_mapping.end(), host_offset,
+    [](uintptr host_offset, BasicBlock::HostMapping const& mapping) {
+      return host_offset < mapping.host_offset;
+    });
+
+  auto key = basic_block->key;
+  u32 address;
+
+  if (mapping != host_mapping.begin()) {
+    address = std::prev(mapping)->guest_address;
+  } else {
+    // Blocks restored from a code cache file have no host mapping.
+    address = key.Address() - 2 * (key.Thumb() ? sizeof(u16) : sizeof(u32));
+  }
+
+  samples[{key.value, address}]++;
+}
+
+} // namespace lunatic
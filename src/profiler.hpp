@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <lunatic/cpu.hpp>
+#include <map>
+#include <utility>
+
+#include "frontend/basic_block.hpp"
+
+namespace lunatic {
+
+/**
+ * Sampling profiler, which attributes the time spent in compiled code to guest instructions.
+ * A SIGPROF timer records the host program counter into a ring buffer. The samples are resolved
+ * later (outside of the signal handler) via an index of the host code ranges of all compiled blocks,
+ * which must happen before any block is released.
+ */
+struct Profiler {
+  ~Profiler();
+
+  void Start(int interval_us);
+  void Stop();
+  bool IsActive() const { return active; }
+
+  void AddBasicBlock(frontend::BasicBlock const& basic_block);
+  void RemoveBasicBlock(frontend::BasicBlock const& basic_block);
+
+  void ResolveSamples();
+  auto GetProfile() -> CPU::Profile;
+
+  static constexpr u64 kSampleBufferSize = 4096;
+
+  // Written by the signal handler and read by the thread, which the handler interrupts.
+  struct SampleBuffer {
+    uintptr host_pc[kSampleBufferSize];
+    std::atomic<u64> write_index{0};
+  };
+
+private:
+  void Resolve(uintptr host_pc);
+
+  bool active = false;
+  SampleBuffer sample_buffer;
+  u64 read_index = 0;
+
+  std::map<uintptr, frontend::BasicBlock const*> host_code_map;
+
+  // Maps the basic block key and the address of the guest instruction to the number of samples.
+  std::map<std::pair<u64, u32>, u64> samples;
+  u64 samples_total = 0;
+  u64 samples_outside_guest_code = 0;
+  u64 samples_dropped = 0;
+};
+
+} // namespace lunatic
@@ -217,6 +217,12 @@ int main(int argc, char** argv) {
     }
   });
   jit->SetGPR(GPR::PC, header.arm9.entrypoint);
+  jit->Precompile(
+    header.arm9.load_address,
+    header.arm9.load_address + header.arm9.size - 1,
+    Mode::System,
+    false
+  );
 
   SDL_Init(SDL_INIT_VIDEO);
 
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <cstring>
+#include <fmt/format.h>
+#include <lunatic/cpu.hpp>
+
+#include "common/flat_memory.hpp"
+
+using namespace lunatic;
+
+/**
+ * Block A and block B both rely on block C not reading the flags, and they also rely on each other.
+ * Releasing block C releases A, whose release callback in turn releases B, while B is still
+ * in the list of dependents of C. Build with AddressSanitizer to catch use-after-free regressions.
+ */
+static const u32 kCode[] {
+  0xE3500000, // 0x00 A: cmp r0, #0
+  0x0A000001, // 0x04    beq C
+  0xE3510000, // 0x08 B: cmp r1, #0
+  0x0AFFFFFB, // 0x0C    beq A
+  0xE3520000, // 0x10 C: cmp r2, #0
+  0xE3A0302A, // 0x14    mov r3, #42
+  0xEAFFFFFC  // 0x18    b C
+};
+
+static constexpr u32 kCodeAddress = 0x00001000;
+
+int main() {
+  auto memory = FlatMemory{};
+  auto cpu = CreateCPU(CPU::Descriptor{memory});
+  auto cpsr = StatusRegister{};
+
+  std::memcpy(&memory.ram[kCodeAddress], kCode, sizeof(kCode));
+
+  cpsr.f.mode = Mode::System;
+  cpu->SetCPSR(cpsr);
+  cpu->SetGPR(GPR::R0, 1);
+  cpu->SetGPR(GPR::R1, 1);
+  cpu->SetGPR(GPR::PC, kCodeAddress);
+
+  // Compile A, B and C, so that A and B are compiled knowing that their successors overwrite the flags.
+  cpu->Precompile(kCodeAddress, kCodeAddress + sizeof(kCode) - 4, Mode::System, false);
+
+  auto compiled_blocks = cpu->GetStatistics().compiled_blocks;
+
+  // Releasing C must release A and B as well.
+  cpu->ClearICacheRange(kCodeAddress + 0x10, kCodeAddress + 0x10);
+  cpu->Run(1000);
+
+  if (cpu->GetGPR(GPR::R3) != 42) {
+    fmt::print(stderr, "flag-dependents: expected r3 = 42, got r3 = {}\n", cpu->GetGPR(GPR::R3));
+    return 1;
+  }
+
+  if (cpu->GetStatistics().compiled_blocks < compiled_blocks + 3) {
+    fmt::print(stderr, "flag-dependents: A and B were not recompiled after C was released\n");
+    return 1;
+  }
+
+  return 0;
+}
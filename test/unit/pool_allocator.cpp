@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2022 fleroviux. All rights reserved.
+ *
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fmt/format.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/pool_allocator.hpp"
+
+using namespace lunatic;
+
+/**
+ * Producer threads allocate objects of every size class and hand them to consumer threads,
+ * which release them. Producers exit while consumers still hold some of their objects,
+ * so objects are released both while the owning thread is alive and after it has exited.
+ * Build with ThreadSanitizer and with AddressSanitizer to catch races and use-after-free regressions.
+ */
+static constexpr int kProducers = 4;
+static constexpr int kConsumers = 4;
+static constexpr int kRounds = 8;
+static constexpr int kObjectsPerRound = 20000;
+static constexpr size_t kSizes[] { 24, 64, 100, 128, 200, 256, 512, 1024 };
+
+struct Object {
+  void* data;
+  size_t size;
+  u8 pattern;
+};
+
+struct Queue {
+  void Push(Object object) {
+    auto lock = std::unique_lock{mutex};
+    objects.push_back(object);
+    cv.notify_one();
+  }
+
+  bool Pop(Object& object) {
+    auto lock = std::unique_lock{mutex};
+    cv.wait(lock, [this] { return !objects.empty() || done; });
+    if (objects.empty()) {
+      return false;
+    }
+    object = objects.front();
+    objects.pop_front();
+    return true;
+  }
+
+  void Close() {
+    auto lock = std::unique_lock{mutex};
+    done = true;
+    cv.notify_all();
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Object> objects;
+  bool done = false;
+};
+
+int main() {
+  Queue queues[kConsumers];
+  std::atomic_int errors = 0;
+
+  auto consume = [&](Queue& queue) {
+    auto object = Object{};
+
+    while (queue.Pop(object)) {
+      auto data = (u8*)object.data;
+
+      for (size_t i = 0; i < object.size; i++) {
+        if (data[i] != object.pattern) {
+          errors++;
+          break;
+        }
+      }
+      PoolRelease(object.data, object.size);
+    }
+  };
+
+  auto produce = [&](int id) {
+    auto local = std::vector<Object>{};
+
+    for (int i = 0; i < kObjectsPerRound; i++) {
+      auto size = kSizes[(id + i) % std::size(kSizes)];
+      auto object = Object{PoolAllocate(size), size, (u8)(id * 31 + i)};
+
+      std::memset(object.data, object.pattern, size);
+
+      // Release some objects on the owning thread, interleaved with the remote releases.
+      if (i % 3 == 0) {
+        local.push_back(object);
+        if (local.size() > 64) {
+          PoolRelease(local.front().data, local.front().size);
+          local.erase(local.begin());
+        }
+      } else {
+        queues[(id + i) % kConsumers].Push(object);
+      }
+    }
+
+    for (auto& object : local) {
+      PoolRelease(object.data, object.size);
+    }
+  };
+
+  auto consumers = std::vector<std::thread>{};
+
+  for (auto& queue : queues) {
+    consumers.emplace_back(consume, std::ref(queue));
+  }
+
+  for (int round = 0; round < kRounds; round++) {
+    auto producers = std::vector<std::thread>{};
+
+    for (int id = 0; id < kProducers; id++) {
+      producers.emplace_back(produce, round * kProducers + id);
+    }
+
+    for (auto& producer : producers) {
+      producer.join();
+    }
+  }
+
+  for (auto& queue : queues) {
+    queue.Close();
+  }
+
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+
+  if (errors != 0) {
+    fmt::print(stderr, "pool-allocator: {} objects were corrupted\n", errors.load());
+    return 1;
+  }
+
+  return 0;
+}